@@ -0,0 +1,84 @@
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include "access-log.hpp"
+
+access_log::access_log (std::string const& path)
+    : mhead (0), mtail (0), mpartial (0),
+      mfd (::open (path.c_str (), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644))
+{
+}
+
+access_log::~access_log ()
+{
+    flush ();
+    if (mfd >= 0)
+        ::close (mfd);
+}
+
+void
+access_log::fill (record& r, std::string const& method, std::string const& path,
+                  int status, std::uint64_t bytes_in, std::uint64_t bytes_out)
+{
+    struct timespec ts;
+    ::clock_gettime (CLOCK_REALTIME, &ts);
+    std::memset (&r, 0, sizeof (r));
+    r.time_usec = static_cast<std::uint64_t> (ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    r.bytes_in = bytes_in;
+    r.bytes_out = bytes_out;
+    r.status = static_cast<std::uint16_t> (status);
+    r.method = method == "GET" ? GET : method == "POST" ? POST : method == "HEAD" ? HEAD : OTHER;
+    std::size_t const n = std::min (path.size (), sizeof (r.path));
+    std::memcpy (r.path, path.data (), n);
+    r.path_size = static_cast<std::uint8_t> (n);
+}
+
+void
+access_log::push (record const& r)
+{
+    std::uint64_t const head = mhead;
+    if (head - __atomic_load_n (&mtail, __ATOMIC_ACQUIRE) >= NRING)
+        return;
+    mring[head % NRING] = r;
+    __atomic_store_n (&mhead, head + 1, __ATOMIC_RELEASE);
+}
+
+// the records wrapped around the end of the ring are written together.
+// the tail moves past the records written whole, and a short write is
+// followed at once by the rest, so that a record cut in two is kept
+// together as far as the file takes it.
+bool
+access_log::flush ()
+{
+    std::uint64_t tail = mtail;
+    std::uint64_t const head = __atomic_load_n (&mhead, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return true;
+    if (mfd < 0)
+        return false;
+    while (head != tail) {
+        std::size_t const first = tail % NRING;
+        std::size_t const n = head - tail;
+        std::size_t const n1 = std::min (n, NRING - first);
+        struct iovec iov[2] = {
+            {reinterpret_cast<char*> (&mring[first]) + mpartial, n1 * sizeof (record) - mpartial},
+            {&mring[0], (n - n1) * sizeof (record)}
+        };
+        ssize_t const size = ::writev (mfd, iov, n1 < n ? 2 : 1);
+        if (size < 0 && EINTR == errno)
+            continue;
+        if (size <= 0)
+            return false;
+        std::size_t const done = mpartial + size;
+        tail += done / sizeof (record);
+        mpartial = done % sizeof (record);
+        __atomic_store_n (&mtail, tail, __ATOMIC_RELEASE);
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+/* binary access log of fixed-size records
+ *
+ *      access_log log ("data/suzume.access");
+ *      access_log::record r;
+ *      access_log::fill (r, "GET", "/suzume.cgi?before=10", 200, 0, 1234);
+ *      r.usec[access_log::TOTAL] = 850;
+ *      log.push (r);
+ *      log.flush ();       // one write (2) of the records pushed
+ *
+ * a record is copied as it is into a ring buffer, without formatting,
+ * and the pending records are appended to the file by one writev with
+ * O_APPEND, so that the records of the processes are never interleaved.
+ * push is safe against one thread that flushes at the same time. when
+ * the ring is full, the record is dropped. the records not written are
+ * kept for the next flush, and the rest of a record written in part
+ * goes right after it. suzume-accesslog decodes the file into text.
+ */
+
+class access_log {
+public:
+    enum { TOTAL, CALL, RENDER, COMMIT, NPHASE };
+    enum { GET, POST, HEAD, OTHER };
+
+    struct record {
+        std::uint64_t time_usec;        // since the epoch
+        std::uint64_t bytes_in;
+        std::uint64_t bytes_out;
+        std::uint32_t usec[NPHASE];
+        std::uint16_t status;
+        std::uint8_t method;
+        std::uint8_t path_size;
+        char path[84];                  // truncated
+    };
+
+    explicit access_log (std::string const& path);
+    ~access_log ();
+    static void fill (record& r, std::string const& method, std::string const& path,
+                      int status, std::uint64_t bytes_in, std::uint64_t bytes_out);
+    void push (record const& r);
+    bool flush ();
+
+private:
+    enum { NRING = 64 };
+
+    record mring[NRING];
+    std::uint64_t mhead;                // next to push
+    std::uint64_t mtail;                // next to flush
+    std::size_t mpartial;               // bytes of mring[mtail] written
+    int mfd;
+
+    access_log (access_log const&);
+    access_log& operator= (access_log const&);
+};
+
+static_assert (sizeof (access_log::record) == 128, "access_log::record is 128 bytes");
@@ -0,0 +1,223 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "archive.hpp"
+
+static const char MAGIC[8] = {'s', 'u', 'z', 'u', 'm', 'e', 'S', '1'};
+static const std::uint32_t NO_HTML = 0xffffffffU;
+static const char SUFFIX[] = ".seg";
+
+archive::archive (std::string const& dir)
+    : mdir (dir), mscanned (false), mmapped (false), mname (), mnewest (0), msegment ()
+{
+}
+
+archive::~archive ()
+{
+    for (auto& seg : msegment)
+        ::munmap (seg.map, seg.size);
+}
+
+// the last id of the newest segment whose header is whole.
+void
+archive::scan () const
+{
+    if (mscanned)
+        return;
+    mscanned = true;
+    DIR* d = ::opendir (mdir.c_str ());
+    if (d == nullptr)
+        return;
+    while (struct dirent* e = ::readdir (d)) {
+        std::string const name = e->d_name;
+        std::size_t const n = sizeof (SUFFIX) - 1;
+        if (name.size () > n && name.compare (name.size () - n, n, SUFFIX) == 0)
+            mname.push_back (name);
+    }
+    ::closedir (d);
+    // named by the zero padded first id, so that sorted by the names.
+    std::sort (mname.begin (), mname.end ());
+    for (auto name = mname.crbegin (); name != mname.crend () && 0 == mnewest; ++name) {
+        int const fd = ::open ((mdir + "/" + *name).c_str (), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        header_type header;
+        if (::pread (fd, &header, sizeof (header), 0) == static_cast<ssize_t> (sizeof (header))
+                && std::memcmp (header.magic, MAGIC, sizeof (MAGIC)) == 0 && header.count > 0)
+            mnewest = header.last_id;
+        ::close (fd);
+    }
+}
+
+void
+archive::map () const
+{
+    if (mmapped)
+        return;
+    scan ();
+    mmapped = true;
+    for (auto const& name : mname)
+        map_segment (mdir + "/" + name);
+}
+
+std::int64_t
+archive::newest_id () const
+{
+    scan ();
+    return mnewest;
+}
+
+std::int64_t
+archive::oldest_id () const
+{
+    map ();
+    return msegment.empty () ? 0 : msegment.front ().header->first_id;
+}
+
+// the entries with ids less than id, newest first.
+void
+archive::before (std::int64_t id, std::size_t limit, std::vector<entry>& rows) const
+{
+    map ();
+    rows.clear ();
+    for (auto seg = msegment.crbegin (); seg != msegment.crend () && rows.size () < limit; ++seg) {
+        if (seg->header->first_id >= id)
+            continue;
+        index_type const* const first = seg->index;
+        index_type const* const last = seg->index + seg->header->count;
+        index_type const* p = std::lower_bound (first, last, id,
+            [](index_type const& x, std::int64_t y) { return x.id < y; });
+        while (p != first && rows.size () < limit)
+            rows.push_back (entry_at (*seg, --p - first));
+    }
+}
+
+// the entries with ids greater than id, oldest first.
+void
+archive::after (std::int64_t id, std::size_t limit, std::vector<entry>& rows) const
+{
+    map ();
+    rows.clear ();
+    for (auto seg = msegment.cbegin (); seg != msegment.cend () && rows.size () < limit; ++seg) {
+        if (seg->header->last_id <= id)
+            continue;
+        index_type const* const first = seg->index;
+        index_type const* const last = seg->index + seg->header->count;
+        index_type const* p = std::upper_bound (first, last, id,
+            [](std::int64_t y, index_type const& x) { return y < x.id; });
+        for (; p != last && rows.size () < limit; ++p)
+            rows.push_back (entry_at (*seg, p - first));
+    }
+}
+
+archive::entry
+archive::entry_at (segment_type const& seg, std::size_t i)
+{
+    index_type const& x = seg.index[i];
+    entry e;
+    e.id = x.id;
+    e.body = seg.data + x.offset;
+    e.body_size = x.body_size;
+    e.html = NO_HTML == x.html_size ? nullptr : e.body + x.body_size;
+    e.html_size = NO_HTML == x.html_size ? 0 : x.html_size;
+    return e;
+}
+
+// a segment is taken only when its index and data fit in the file,
+// and it begins after the one before it.
+bool
+archive::map_segment (std::string const& path) const
+{
+    int const fd = ::open (path.c_str (), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (::fstat (fd, &st) < 0 || st.st_size < static_cast<off_t> (sizeof (header_type))) {
+        ::close (fd);
+        return false;
+    }
+    segment_type seg;
+    seg.size = st.st_size;
+    seg.map = ::mmap (nullptr, seg.size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close (fd);
+    if (MAP_FAILED == seg.map)
+        return false;
+    char const* const base = static_cast<char const*> (seg.map);
+    seg.header = reinterpret_cast<header_type const*> (base);
+    seg.index = reinterpret_cast<index_type const*> (base + sizeof (header_type));
+    std::uint64_t const count = seg.header->count;
+    bool ok = std::memcmp (seg.header->magic, MAGIC, sizeof (MAGIC)) == 0 && count > 0
+        && count <= (seg.size - sizeof (header_type)) / sizeof (index_type)
+        && (msegment.empty () || msegment.back ().header->last_id < seg.header->first_id);
+    if (ok) {
+        seg.data = base + sizeof (header_type) + count * sizeof (index_type);
+        std::size_t const room = base + seg.size - seg.data;
+        index_type const& last = seg.index[count - 1];
+        std::uint64_t const html = NO_HTML == last.html_size ? 0 : last.html_size;
+        ok = seg.index[0].id == seg.header->first_id && last.id == seg.header->last_id
+            && last.offset + last.body_size + html <= room;
+    }
+    if (! ok) {
+        ::munmap (seg.map, seg.size);
+        return false;
+    }
+    msegment.push_back (seg);
+    return true;
+}
+
+// written aside, synced and renamed, so that a segment is either whole
+// or absent.
+bool
+archive::write_segment (std::string const& dir, std::vector<row_type> const& rows)
+{
+    if (rows.empty ())
+        return false;
+    header_type header;
+    std::memset (&header, 0, sizeof (header));
+    std::memcpy (header.magic, MAGIC, sizeof (MAGIC));
+    header.count = rows.size ();
+    header.first_id = rows.front ().id;
+    header.last_id = rows.back ().id;
+    std::vector<index_type> index;
+    std::string data;
+    for (auto const& row : rows) {
+        if (! index.empty () && index.back ().id >= row.id)
+            return false;
+        index_type x;
+        x.id = row.id;
+        x.offset = data.size ();
+        x.body_size = row.body.size ();
+        x.html_size = row.has_html ? row.html.size () : NO_HTML;
+        index.push_back (x);
+        data += row.body;
+        if (row.has_html)
+            data += row.html;
+    }
+    char name[32];
+    std::snprintf (name, sizeof (name), "%019lld", static_cast<long long> (header.first_id));
+    std::string const path = dir + "/" + name + SUFFIX;
+    std::string const tmpname = path + "." + std::to_string (::getpid ());
+    std::FILE* out = std::fopen (tmpname.c_str (), "wb");
+    if (out == nullptr)
+        return false;
+    bool ok = std::fwrite (&header, sizeof (header), 1, out) == 1
+        && std::fwrite (index.data (), sizeof (index_type), index.size (), out) == index.size ()
+        && std::fwrite (data.data (), 1, data.size (), out) == data.size ()
+        && std::fflush (out) == 0
+        && ::fsync (::fileno (out)) == 0;
+    ok = std::fclose (out) == 0 && ok;
+    if (! ok || std::rename (tmpname.c_str (), path.c_str ()) != 0) {
+        std::remove (tmpname.c_str ());
+        return false;
+    }
+    return true;
+}
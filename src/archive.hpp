@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/* immutable segments of the old entries
+ *
+ *      archive cold ("data/archive");
+ *      std::vector<archive::entry> rows;
+ *      cold.before (id, 20, rows);     // newest first, ids less than id
+ *      cold.after (id, 20, rows);      // oldest first, ids greater than id
+ *
+ * the entries older than the live table are moved out of the database
+ * into segment files named by their first id in the directory. the
+ * segments do not overlap and never change once written. each of them
+ * holds the index of the ids in ascending order and the bodies, and is
+ * mapped into memory read-only, so that the entries handed out point
+ * into the maps while the archive lives. nothing is opened until asked:
+ * newest_id reads the header of the newest segment alone, and the
+ * segments are mapped at the first lookup of the entries.
+ */
+
+class archive {
+public:
+    struct entry {
+        std::int64_t id;
+        char const* body;
+        std::size_t body_size;
+        char const* html;       // nullptr when the entry has not got one
+        std::size_t html_size;
+    };
+
+    // a row to write into a segment, with html empty if not given.
+    struct row_type {
+        std::int64_t id;
+        std::string body;
+        std::string html;
+        bool has_html;
+    };
+
+    explicit archive (std::string const& dir);
+    ~archive ();
+    bool empty () const { return newest_id () == 0; }
+    std::int64_t newest_id () const;
+    std::int64_t oldest_id () const;
+    void before (std::int64_t id, std::size_t limit, std::vector<entry>& rows) const;
+    void after (std::int64_t id, std::size_t limit, std::vector<entry>& rows) const;
+
+    // write the rows of ascending ids newer than the archive as a segment.
+    static bool write_segment (std::string const& dir, std::vector<row_type> const& rows);
+
+private:
+    struct header_type {
+        char magic[8];
+        std::uint64_t count;
+        std::int64_t first_id;
+        std::int64_t last_id;
+    };
+
+    struct index_type {
+        std::int64_t id;
+        std::uint64_t offset;
+        std::uint32_t body_size;
+        std::uint32_t html_size;
+    };
+
+    struct segment_type {
+        void* map;
+        std::size_t size;
+        header_type const* header;
+        index_type const* index;
+        char const* data;
+    };
+
+    void scan () const;
+    void map () const;
+    bool map_segment (std::string const& path) const;
+    static entry entry_at (segment_type const& seg, std::size_t i);
+
+    std::string const mdir;
+    mutable bool mscanned;
+    mutable bool mmapped;
+    mutable std::vector<std::string> mname;         // sorted segment files
+    mutable std::int64_t mnewest;
+    mutable std::vector<segment_type> msegment;     // in ascending order of ids
+
+    archive (archive const&);
+    archive& operator= (archive const&);
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+/* bump-pointer arena for the objects of a request
+ *
+ *      arena memory;
+ *      {
+ *          std::vector<int, arena_allocator<int>> v (arena_allocator<int> (&memory));
+ *          ...
+ *      }
+ *      memory.reset ();
+ *
+ * allocations take the next bytes of the current block, and are never
+ * freed one by one. reset gives them back all at once after the objects
+ * have gone, and keeps the first block for the next request. a request
+ * larger than a quarter of a block gets a block of its own. an allocator
+ * without an arena falls back to the global heap.
+ *
+ * in the http objects, it holds the nodes of the containers only: the
+ * map nodes of env, and the arrays of the parameter strings. the bytes
+ * of the strings in them, and of the response body, are std::string
+ * and stay on the heap.
+ */
+
+class arena {
+public:
+    explicit arena (std::size_t block_size = 16384)
+        : mblock (), mlarge (), mblock_size (block_size), mptr (nullptr), mend (nullptr) {}
+
+    ~arena ()
+    {
+        release (0);
+    }
+
+    void* allocate (std::size_t n, std::size_t align)
+    {
+        if (n > mblock_size / 4) {
+            mlarge.push_back (new_block (n));
+            return mlarge.back ();
+        }
+        std::size_t pad = (align - reinterpret_cast<std::size_t> (mptr) % align) % align;
+        if (mptr == nullptr || static_cast<std::size_t> (mend - mptr) < pad + n) {
+            mblock.push_back (new_block (mblock_size));
+            mptr = mblock.back ();
+            mend = mptr + mblock_size;
+            pad = 0;
+        }
+        void* const p = mptr + pad;
+        mptr += pad + n;
+        return p;
+    }
+
+    void reset ()
+    {
+        release (1);
+        mptr = mblock.empty () ? nullptr : mblock[0];
+        mend = mblock.empty () ? nullptr : mblock[0] + mblock_size;
+    }
+
+private:
+    std::vector<char*> mblock;
+    std::vector<char*> mlarge;
+    std::size_t const mblock_size;
+    char* mptr;
+    char* mend;
+
+    static char* new_block (std::size_t n)
+    {
+        char* const p = static_cast<char*> (std::malloc (n));
+        if (p == nullptr)
+            throw std::bad_alloc ();
+        return p;
+    }
+
+    // free the large blocks and the blocks but the first keep ones.
+    void release (std::size_t keep)
+    {
+        for (char* p : mlarge)
+            std::free (p);
+        mlarge.clear ();
+        for (std::size_t i = keep; i < mblock.size (); ++i)
+            std::free (mblock[i]);
+        if (mblock.size () > keep)
+            mblock.resize (keep);
+    }
+
+    arena (arena const&);
+    arena& operator= (arena const&);
+};
+
+template<typename T>
+struct arena_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    arena* heap;
+
+    arena_allocator () noexcept : heap (nullptr) {}
+    explicit arena_allocator (arena* a) noexcept : heap (a) {}
+    template<typename U>
+    arena_allocator (arena_allocator<U> const& other) noexcept : heap (other.heap) {}
+
+    T* allocate (std::size_t n)
+    {
+        if (heap == nullptr)
+            return static_cast<T*> (::operator new (n * sizeof (T)));
+        return static_cast<T*> (heap->allocate (n * sizeof (T), alignof (T)));
+    }
+
+    void deallocate (T* p, std::size_t n)
+    {
+        if (heap == nullptr)
+            ::operator delete (p);
+    }
+};
+
+template<typename T, typename U>
+inline bool
+operator== (arena_allocator<T> const& a, arena_allocator<U> const& b)
+{
+    return a.heap == b.heap;
+}
+
+template<typename T, typename U>
+inline bool
+operator!= (arena_allocator<T> const& a, arena_allocator<U> const& b)
+{
+    return a.heap != b.heap;
+}
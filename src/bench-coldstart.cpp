@@ -0,0 +1,101 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+/* time from exec to the first byte of a CGI program's response
+ *
+ *      $ cd /path/to/app && bench-coldstart 200 ./suzume.cgi
+ *
+ * runs the program for a GET of the front page the given times, and
+ * prints the percentiles of the time to the first byte of the response
+ * on the pipe and of the time to its exit, in microseconds.
+ */
+
+static std::uint64_t
+now_usec ()
+{
+    struct timespec ts;
+    ::clock_gettime (CLOCK_MONOTONIC, &ts);
+    return static_cast<std::uint64_t> (ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool
+run (char const* program, std::uint64_t& first_byte, std::uint64_t& exit)
+{
+    static char* const ENV[] = {
+        const_cast<char*> ("REQUEST_METHOD=GET"),
+        const_cast<char*> ("SCRIPT_NAME=/suzume.cgi"),
+        const_cast<char*> ("QUERY_STRING="),
+        nullptr
+    };
+    int fd[2];
+    if (::pipe (fd) < 0)
+        return false;
+    std::uint64_t const t0 = now_usec ();
+    pid_t const pid = ::fork ();
+    if (pid < 0)
+        return false;
+    if (0 == pid) {
+        int const null = ::open ("/dev/null", O_RDONLY);
+        ::dup2 (null, 0);
+        ::dup2 (fd[1], 1);
+        ::close (fd[0]);
+        ::close (fd[1]);
+        char* const argv[] = {const_cast<char*> (program), nullptr};
+        ::execve (program, argv, ENV);
+        ::_exit (127);
+    }
+    ::close (fd[1]);
+    char buf[4096];
+    ssize_t n = ::read (fd[0], buf, 1);
+    first_byte = now_usec () - t0;
+    while (n > 0)
+        n = ::read (fd[0], buf, sizeof (buf));
+    ::close (fd[0]);
+    int status;
+    ::waitpid (pid, &status, 0);
+    exit = now_usec () - t0;
+    return WIFEXITED (status) && 0 == WEXITSTATUS (status);
+}
+
+static void
+report (char const* name, std::vector<std::uint64_t>& t)
+{
+    std::sort (t.begin (), t.end ());
+    std::size_t const n = t.size ();
+    std::printf ("%-10s min %6llu  p50 %6llu  p90 %6llu  p99 %6llu  max %6llu\n", name,
+        static_cast<unsigned long long> (t[0]),
+        static_cast<unsigned long long> (t[n / 2]),
+        static_cast<unsigned long long> (t[n * 9 / 10]),
+        static_cast<unsigned long long> (t[n * 99 / 100]),
+        static_cast<unsigned long long> (t[n - 1]));
+}
+
+int
+main (int argc, char* argv[])
+{
+    if (argc != 3 || std::atoi (argv[1]) <= 0) {
+        std::fprintf (stderr, "usage: %s COUNT PROGRAM\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int const count = std::atoi (argv[1]);
+    std::vector<std::uint64_t> first_byte, exit;
+    for (int i = 0; i < count; ++i) {
+        std::uint64_t t1, t2;
+        if (! run (argv[2], t1, t2)) {
+            std::fprintf (stderr, "%s: failed\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+        first_byte.push_back (t1);
+        exit.push_back (t2);
+    }
+    report ("first byte", first_byte);
+    report ("exit", exit);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+#include <string>
+#include <map>
+#include <cstdlib>
+#include <algorithm>
+#include <zlib.h>
+#include "http.hpp"
+
+namespace http {
+
+enum { GZIP_WINDOW = 15 + 16, DEFLATE_WINDOW = 15, MEMLEVEL = 8 };
+
+static std::string
+lowercase (std::string const& str, std::size_t first, std::size_t last)
+{
+    std::string t;
+    for (std::size_t i = first; i < last; ++i) {
+        char const c = str[i];
+        t.push_back ('A' <= c && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+    return t;
+}
+
+// quality value of the q parameter, 1 when not given.
+static double
+quality (std::string const& param)
+{
+    std::size_t const q = param.find ("q=");
+    if (q == param.npos)
+        return 1.0;
+    return std::strtod (param.c_str () + q + 2, nullptr);
+}
+
+// Accept-Encoding: gzip, deflate;q=0.5, *;q=0
+// the coding of the highest quality, gzip before deflate on a tie.
+std::string
+accept_encoding (env_type const& env)
+{
+    auto const it = env.find ("HTTP_ACCEPT_ENCODING");
+    if (it == env.end ())
+        return "";
+    std::string const& field = it->second;
+    double gzip = -1.0, deflate = -1.0, any = -1.0;
+    for (std::size_t pos = 0; pos < field.size (); ) {
+        std::size_t const comma = std::min (field.find (',', pos), field.size ());
+        std::size_t const semi = std::min (field.find (';', pos), comma);
+        std::size_t const first = std::min (field.find_first_not_of (" \t", pos), semi);
+        std::size_t last = semi;
+        while (last > first && (' ' == field[last - 1] || '\t' == field[last - 1]))
+            --last;
+        std::string const coding = lowercase (field, first, last);
+        double const q = quality (lowercase (field, semi, comma));
+        if ("gzip" == coding || "x-gzip" == coding)
+            gzip = q;
+        else if ("deflate" == coding)
+            deflate = q;
+        else if ("*" == coding)
+            any = q;
+        pos = comma + 1;
+    }
+    if (gzip < 0.0)
+        gzip = any;
+    if (deflate < 0.0)
+        deflate = any;
+    if (gzip > 0.0 && gzip >= deflate)
+        return "gzip";
+    if (deflate > 0.0)
+        return "deflate";
+    return "";
+}
+
+static bool
+deflate_init (std::string const& coding, z_stream& z)
+{
+    int window;
+    if ("gzip" == coding)
+        window = GZIP_WINDOW;
+    else if ("deflate" == coding)
+        window = DEFLATE_WINDOW;
+    else
+        return false;
+    z.zalloc = Z_NULL;
+    z.zfree = Z_NULL;
+    z.opaque = Z_NULL;
+    return Z_OK == deflateInit2 (&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window, MEMLEVEL, Z_DEFAULT_STRATEGY);
+}
+
+// deflate in HTTP is the zlib format of RFC 1950.
+bool
+content_encode (std::string const& coding, std::string const& input, std::string& output)
+{
+    z_stream z;
+    if (! deflate_init (coding, z))
+        return false;
+    output.resize (deflateBound (&z, input.size ()) + 32);
+    z.next_in = reinterpret_cast<Bytef*> (const_cast<char*> (input.data ()));
+    z.avail_in = input.size ();
+    z.next_out = reinterpret_cast<Bytef*> (&output[0]);
+    z.avail_out = output.size ();
+    int const rc = deflate (&z, Z_FINISH);
+    output.resize (z.total_out);
+    deflateEnd (&z);
+    return Z_STREAM_END == rc;
+}
+
+encoded_length::encoded_length (std::string const& coding)
+    : mz (coding.empty () ? nullptr : new z_stream)
+{
+    if (mz != nullptr && ! deflate_init (coding, *mz)) {
+        delete mz;
+        mz = nullptr;
+    }
+}
+
+encoded_length::~encoded_length ()
+{
+    if (mz != nullptr) {
+        deflateEnd (mz);
+        delete mz;
+    }
+}
+
+// the output goes through a scratch buffer, counted in total_out.
+bool
+encoded_length::deflate_out (int flush)
+{
+    Bytef scratch[4096];
+    int rc;
+    do {
+        mz->next_out = scratch;
+        mz->avail_out = sizeof (scratch);
+        rc = deflate (mz, flush);
+    } while (Z_OK == rc && (0 == mz->avail_out || mz->avail_in > 0 || Z_FINISH == flush));
+    return Z_STREAM_END == rc || (Z_FINISH != flush && (Z_OK == rc || Z_BUF_ERROR == rc));
+}
+
+void
+encoded_length::write (char const* s, std::size_t n)
+{
+    if (mz == nullptr || 0 == n)
+        return;
+    mz->next_in = reinterpret_cast<Bytef*> (const_cast<char*> (s));
+    mz->avail_in = n;
+    if (! deflate_out (Z_NO_FLUSH)) {
+        deflateEnd (mz);
+        delete mz;
+        mz = nullptr;
+    }
+}
+
+bool
+encoded_length::finish (std::size_t& size)
+{
+    if (mz == nullptr)
+        return false;
+    mz->next_in = Z_NULL;
+    mz->avail_in = 0;
+    if (! deflate_out (Z_FINISH))
+        return false;
+    size = mz->total_out;
+    return true;
+}
+
+}//namespace http
@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+
+/* write the template as a C++ source to build it into the program
+ *
+ *      $ embed-template view/suzume.html > build/suzume-template.cpp
+ *
+ * defines suzume_template, its size and suzume_template_stamp, which
+ * stands for the file stamp in the tags of the cached pages.
+ */
+
+static bool
+slurp (char const* name, std::string& src)
+{
+    std::FILE* in = std::fopen (name, "rb");
+    if (in == nullptr)
+        return false;
+    char chunk[4096];
+    for (std::size_t n; (n = std::fread (chunk, 1, sizeof (chunk), in)) > 0; )
+        src.append (chunk, n);
+    bool const ok = ! std::ferror (in);
+    std::fclose (in);
+    return ok;
+}
+
+int
+main (int argc, char* argv[])
+{
+    std::string src;
+    if (argc != 2 || ! slurp (argv[1], src)) {
+        std::fprintf (stderr, "usage: %s TEMPLATE\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::uint64_t h = 14695981039346656037ULL;
+    for (char const c : src) {
+        h ^= static_cast<unsigned char> (c);
+        h *= 1099511628211ULL;
+    }
+    std::printf ("// generated from %s by embed-template.\n", argv[1]);
+    std::printf ("#include <cstddef>\n\n");
+    std::printf ("extern char const suzume_template[] =\n    \"");
+    for (std::size_t i = 0; i < src.size (); ++i) {
+        int const c = static_cast<unsigned char> (src[i]);
+        if ('\n' == c)
+            std::printf (i + 1 < src.size () ? "\\n\"\n    \"" : "\\n");
+        else if ('"' == c || '\\' == c || '?' == c)
+            std::printf ("\\%c", c);
+        else if (c < 0x20 || 0x7f <= c)
+            std::printf ("\\%03o", c);
+        else
+            std::putchar (c);
+    }
+    std::printf ("\";\n");
+    std::printf ("extern std::size_t const suzume_template_size = %zu;\n", src.size ());
+    std::printf ("extern char const suzume_template_stamp[] = \"embed.%016llx\";\n",
+                 static_cast<unsigned long long> (h));
+    return EXIT_SUCCESS;
+}
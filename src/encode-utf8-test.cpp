@@ -0,0 +1,100 @@
+#include <string>
+#include <cstdio>
+#include "encode-utf8.hpp"
+#include "taptests.hpp"
+
+// escape_json - the 16 octets at once against the octet by octet
+
+void test_escape_json (test::simple& ts);
+void test_escape_json_blocks (test::simple& ts);
+
+int
+main (int argc, char* argv[])
+{
+    test::simple ts;
+    test_escape_json (ts);
+    test_escape_json_blocks (ts);
+    return ts.done_testing ();
+}
+
+// one octet at a time, the way the tail after the last block goes.
+static std::string
+escape_json_scalar (std::string const& s)
+{
+    std::string out;
+    for (unsigned char const c : s) {
+        char buf[8];
+        if ('"' == c) out += "\\\"";
+        else if ('\\' == c) out += "\\\\";
+        else if ('\b' == c) out += "\\b";
+        else if ('\f' == c) out += "\\f";
+        else if ('\n' == c) out += "\\n";
+        else if ('\r' == c) out += "\\r";
+        else if ('\t' == c) out += "\\t";
+        else if (c < 0x20) {
+            std::snprintf (buf, sizeof (buf), "\\u%04x", c);
+            out += buf;
+        }
+        else
+            out.push_back (c);
+    }
+    return out;
+}
+
+static std::string
+escape_json (std::string const& s)
+{
+    std::string out;
+    wjson::escape_json (s.data (), s.data () + s.size (), out);
+    return out;
+}
+
+void
+test_escape_json (test::simple& ts)
+{
+    ts.ok (escape_json ("") == "", "empty");
+    ts.ok (escape_json ("abc") == "abc", "plain");
+    ts.ok (escape_json ("a\"b\\c") == "a\\\"b\\\\c", "quote and backslash");
+    ts.ok (escape_json ("\b\f\n\r\t") == "\\b\\f\\n\\r\\t", "short escapes");
+    ts.ok (escape_json (std::string (1, '\0')) == "\\u0000", "0x00");
+    ts.ok (escape_json ("\x1f") == "\\u001f", "0x1f");
+    ts.ok (escape_json ("\x20") == " ", "0x20 is plain");
+    ts.ok (escape_json ("\x7f") == "\x7f", "0x7f is plain");
+    ts.ok (escape_json ("\x80\xff") == "\x80\xff", "0x80 and above are plain");
+    ts.ok (escape_json ("\xe3\x81\x82") == "\xe3\x81\x82", "UTF-8 is plain");
+}
+
+// every octet at every position through two blocks and the tail, in
+// a run of plain octets and in a run of escaped ones.
+void
+test_escape_json_blocks (test::simple& ts)
+{
+    bool plain = true;
+    bool escaped = true;
+    for (int c = 0; c < 256; ++c) {
+        for (std::size_t n = 1; n <= 40; ++n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                std::string s (n, 'a');
+                s[i] = static_cast<char> (c);
+                plain = plain && escape_json (s) == escape_json_scalar (s);
+                std::string t (n, '\x01');
+                t[i] = static_cast<char> (c);
+                escaped = escaped && escape_json (t) == escape_json_scalar (t);
+            }
+        }
+    }
+    ts.ok (plain, "an octet anywhere among plain octets");
+    ts.ok (escaped, "an octet anywhere among escaped octets");
+
+    // the escapes at the last octet of a block and the first of the next.
+    std::string const a15 (15, 'a');
+    std::string const a16 (16, 'a');
+    ts.ok (escape_json (a15 + "\"") == a15 + "\\\"", "quote at the end of a block");
+    ts.ok (escape_json (a16 + "\"") == a16 + "\\\"", "quote at the start of a block");
+    ts.ok (escape_json (a15 + "\\") == a15 + "\\\\", "backslash at the end of a block");
+    ts.ok (escape_json (a16 + "\\") == a16 + "\\\\", "backslash at the start of a block");
+    ts.ok (escape_json (a15 + "\"\\" + a15) == a15 + "\\\"\\\\" + a15,
+        "quote and backslash across blocks");
+    ts.ok (escape_json (a16 + a16 + "\x1f") == a16 + a16 + "\\u001f",
+        "control in the tail after two blocks");
+}
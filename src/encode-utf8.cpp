@@ -2,28 +2,32 @@
 #include <utility>
 #include <cstdint>
 #include "encode-utf8.hpp"
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace wjson {
 
+// append the octets of a code point.
 void
-encode_utf8 (std::ostream& out, std::uint32_t const uc)
+encode_utf8 (std::string& out, std::uint32_t const uc)
 {
     if (uc < 0x80)
-        out.put (uc);
+        out.push_back (uc);
     else if (uc < 0x800) {
-        out.put (((uc >>  6) & 0xff) | 0xc0);
-        out.put (( uc        & 0x3f) | 0x80);
+        out.push_back (((uc >>  6) & 0xff) | 0xc0);
+        out.push_back (( uc        & 0x3f) | 0x80);
     }
     else if (uc < 0x10000) {
-        out.put (((uc >> 12) & 0x0f) | 0xe0);
-        out.put (((uc >>  6) & 0x3f) | 0x80);
-        out.put (( uc        & 0x3f) | 0x80);
+        out.push_back (((uc >> 12) & 0x0f) | 0xe0);
+        out.push_back (((uc >>  6) & 0x3f) | 0x80);
+        out.push_back (( uc        & 0x3f) | 0x80);
     }
     else if (uc < 0x110000) {
-        out.put (((uc >> 18) & 0x07) | 0xf0);
-        out.put (((uc >> 12) & 0x3f) | 0x80);
-        out.put (((uc >>  6) & 0x3f) | 0x80);
-        out.put (( uc        & 0x3f) | 0x80);
+        out.push_back (((uc >> 18) & 0x07) | 0xf0);
+        out.push_back (((uc >> 12) & 0x3f) | 0x80);
+        out.push_back (((uc >>  6) & 0x3f) | 0x80);
+        out.push_back (( uc        & 0x3f) | 0x80);
     }
 }
 
@@ -106,13 +110,19 @@ decode_utf8 (std::string const& octets, std::wstring& str)
 
 bool
 verify_utf8 (std::string const& octets)
+{
+    return verify_utf8 (octets.data (), octets.data () + octets.size ());
+}
+
+bool
+verify_utf8 (char const* first, char const* last)
 {
     static const unsigned long LOWERBOUND[5] = {0, 0, 0x80LU, 0x0800LU, 0x10000LU};
     static const unsigned long UPPERBOUND = 0x10ffffLU;
     int state = 1;
     int length = 1;
     unsigned long code = 0;
-    for (auto s = octets.cbegin (); state > 0 && s != octets.cend (); ++s) {
+    for (char const* s = first; state > 0 && s != last; ++s) {
         unsigned long octet = static_cast<unsigned char> (*s);
         if (0 == (0x80U & octet)) {
             length = state = (1 == state) ? 1 : 0;
@@ -146,4 +156,61 @@ verify_utf8 (std::string const& octets)
     return 1 == state;
 }
 
+// the length of the prefix that needs no escape: no quote, no
+// backslash and no control character. it looks at 16 octets at once
+// with SSE2.
+static std::size_t
+json_plain_span (char const* first, char const* last)
+{
+    char const* p = first;
+#if defined (__SSE2__)
+    __m128i const quote = _mm_set1_epi8 ('"');
+    __m128i const backslash = _mm_set1_epi8 ('\\');
+    __m128i const control = _mm_set1_epi8 (0x1f);
+    for (; last - p >= 16; p += 16) {
+        __m128i const v = _mm_loadu_si128 (reinterpret_cast<__m128i const*> (p));
+        __m128i const m = _mm_or_si128 (
+            _mm_or_si128 (_mm_cmpeq_epi8 (v, quote), _mm_cmpeq_epi8 (v, backslash)),
+            _mm_cmpeq_epi8 (_mm_max_epu8 (v, control), control));
+        int const mask = _mm_movemask_epi8 (m);
+        if (mask != 0)
+            return p - first + __builtin_ctz (mask);
+    }
+#endif
+    for (; p < last; ++p) {
+        unsigned char const c = *p;
+        if ('"' == c || '\\' == c || c < 0x20)
+            break;
+    }
+    return p - first;
+}
+
+void
+escape_json (char const* first, char const* last, std::string& out)
+{
+    static const char HEX[] = "0123456789abcdef";
+    while (first < last) {
+        std::size_t const n = json_plain_span (first, last);
+        out.append (first, n);
+        first += n;
+        if (first == last)
+            break;
+        unsigned char const c = *first++;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            out += "\\u00";
+            out.push_back (HEX[c >> 4]);
+            out.push_back (HEX[c & 15]);
+            break;
+        }
+    }
+}
+
 }//namespace wjson
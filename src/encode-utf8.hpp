@@ -1,14 +1,16 @@
 #pragma once
 
-#include <ostream>
 #include <string>
 #include <cstdint>
 
 namespace wjson {
 
 bool encode_utf8 (std::wstring const& str, std::string& octets);
-void encode_utf8 (std::ostream& out, std::uint32_t const uc);
+void encode_utf8 (std::string& out, std::uint32_t const uc);
 bool decode_utf8 (std::string const& octets, std::wstring& str);
 bool verify_utf8 (std::string const& octets);
+bool verify_utf8 (char const* first, char const* last);
+// append the octets as the contents of a JSON string.
+void escape_json (char const* first, char const* last, std::string& out);
 
 }//namespace wjson
@@ -0,0 +1,112 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "group-commit.hpp"
+#include "taptests.hpp"
+
+// group_commit - the queue recovering from the writers dying partway
+
+typedef group_commit::row_type row_type;
+
+void test_commit (test::simple& ts, std::string const& dir);
+void test_torn_tail (test::simple& ts, std::string const& dir);
+void test_truncated (test::simple& ts, std::string const& dir);
+
+int
+main (int argc, char* argv[])
+{
+    char tmpl[] = "/tmp/group-commit-test.XXXXXX";
+    if (::mkdtemp (tmpl) == nullptr)
+        return EXIT_FAILURE;
+    std::string const dir (tmpl);
+    test::simple ts;
+    test_commit (ts, dir);
+    test_torn_tail (ts, dir);
+    test_truncated (ts, dir);
+    std::remove ((dir + "/q.queue").c_str ());
+    std::remove ((dir + "/q.lock").c_str ());
+    ::rmdir (dir.c_str ());
+    return ts.done_testing ();
+}
+
+static off_t
+file_size (std::string const& path)
+{
+    struct stat st;
+    return ::stat (path.c_str (), &st) == 0 ? st.st_size : -1;
+}
+
+void
+test_commit (test::simple& ts, std::string const& dir)
+{
+    group_commit queue (dir + "/q", 0, 64);
+    std::vector<row_type> got;
+    bool const ok = queue.submit ({"a", "b"}, [&](std::vector<row_type> const& rows) {
+        got = rows;
+        return true;
+    });
+    ts.ok (ok && got == std::vector<row_type> {{"a", "b"}}, "commit a row");
+    ts.ok (! queue.submit ({"c"}, [](std::vector<row_type> const&) { return false; }),
+        "a failed commit is reported");
+}
+
+// the bytes of a record whose writer died before its header are ignored.
+void
+test_torn_tail (test::simple& ts, std::string const& dir)
+{
+    std::string const path = dir + "/q.queue";
+    off_t const size = file_size (path);
+    std::FILE* out = std::fopen (path.c_str (), "ab");
+    std::fwrite ("\x09\0\0\0\0\0\0\0\x20\0", 1, 10, out);
+    std::fclose (out);
+    group_commit queue (dir + "/q", 0, 64);
+    std::vector<row_type> got;
+    bool const ok = queue.submit ({"d"}, [&](std::vector<row_type> const& rows) {
+        got = rows;
+        return true;
+    });
+    ts.ok (ok && got == std::vector<row_type> {{"d"}}, "torn tail is ignored");
+    ts.ok (file_size (path) == size, "torn tail is truncated");
+}
+
+// a record accounted for in the header but cut off in the file is lost,
+// and its poster is told so, while the queue goes on.
+void
+test_truncated (test::simple& ts, std::string const& dir)
+{
+    std::string const path = dir + "/q.queue";
+    off_t const size = file_size (path);
+    group_commit queue (dir + "/q", 0, 1);
+    bool second = true;
+    std::vector<row_type> got;
+    std::thread poster;
+    bool const first = queue.submit ({"e"}, [&](std::vector<row_type> const& rows) {
+        got.insert (got.end (), rows.begin (), rows.end ());
+        poster = std::thread ([&]() {
+            second = queue.submit ({"ffffffff"}, [&](std::vector<row_type> const& rows) {
+                got.insert (got.end (), rows.begin (), rows.end ());
+                return true;
+            });
+        });
+        while (file_size (path) <= size)
+            ::usleep (1000);
+        ::truncate (path.c_str (), file_size (path) - 4);
+        return true;
+    });
+    poster.join ();
+    bool done = false;
+    bool const third = queue.submit ({"g"}, [&](std::vector<row_type> const& rows) {
+        got.insert (got.end (), rows.begin (), rows.end ());
+        done = true;
+        return true;
+    });
+    ts.ok (first, "the row before the cut commits");
+    ts.ok (! second, "the row cut off is reported lost");
+    ts.ok (third && done, "the queue goes on after the cut");
+    ts.ok (got == std::vector<row_type> {{"e"}, {"g"}}, "only the whole rows are committed");
+    ts.ok (file_size (path) == size, "the queue is emptied");
+}
@@ -0,0 +1,321 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include "group-commit.hpp"
+
+static const char MAGIC[8] = {'s', 'u', 'z', 'u', 'm', 'e', 'Q', '2'};
+
+namespace {
+
+// an open file with its flock, released when closed.
+class file_lock {
+public:
+    explicit file_lock (std::string const& path)
+        : fd (::open (path.c_str (), O_RDWR | O_CREAT | O_CLOEXEC, 0640)) {}
+    ~file_lock () { if (fd >= 0) ::close (fd); }
+    bool lock () { return fd >= 0 && flock_retry (LOCK_EX); }
+    bool unlock () { return fd >= 0 && flock_retry (LOCK_UN); }
+    int fd;
+
+private:
+    bool flock_retry (int operation)
+    {
+        int rc;
+        while ((rc = ::flock (fd, operation)) < 0 && EINTR == errno)
+            ;
+        return 0 == rc;
+    }
+    file_lock (file_lock const&);
+    file_lock& operator= (file_lock const&);
+};
+
+}//namespace
+
+static bool
+pread_all (int fd, void* buf, std::size_t n, off_t pos)
+{
+    char* p = static_cast<char*> (buf);
+    while (n > 0) {
+        ssize_t const k = ::pread (fd, p, n, pos);
+        if (k < 0 && EINTR == errno)
+            continue;
+        if (k <= 0)
+            return false;
+        p += k;
+        pos += k;
+        n -= k;
+    }
+    return true;
+}
+
+static bool
+pwrite_all (int fd, void const* buf, std::size_t n, off_t pos)
+{
+    char const* p = static_cast<char const*> (buf);
+    while (n > 0) {
+        ssize_t const k = ::pwrite (fd, p, n, pos);
+        if (k < 0 && EINTR == errno)
+            continue;
+        if (k <= 0)
+            return false;
+        p += k;
+        pos += k;
+        n -= k;
+    }
+    return true;
+}
+
+template<typename T>
+static void
+put (std::string& buf, T const x)
+{
+    buf.append (reinterpret_cast<char const*> (&x), sizeof (x));
+}
+
+template<typename T>
+static bool
+get (std::string const& buf, std::size_t& pos, T& x)
+{
+    if (buf.size () - pos < sizeof (x))
+        return false;
+    std::memcpy (&x, buf.data () + pos, sizeof (x));
+    pos += sizeof (x);
+    return true;
+}
+
+group_commit::group_commit (std::string const& path, long window, std::size_t max)
+    : queue_path (path + ".queue"), lock_path (path + ".lock"),
+      window_usec (window), max_rows (max > 0 ? max : 1) {}
+
+bool
+group_commit::submit (row_type const& row, commit_type const& commit)
+{
+    file_lock queue (queue_path);
+    std::uint64_t seq = 0;
+    if (! queue.lock ())
+        return false;
+    bool const queued = enqueue (queue.fd, row, seq);
+    if (! queue.unlock () || ! queued)
+        return false;
+    file_lock leader (lock_path);
+    if (! leader.lock ())
+        return false;
+    bool waited = false;
+    std::vector<row_type> rows;
+    for (;;) {
+        bool ok = false;
+        if (! queue.lock ())
+            return false;
+        if (done (queue.fd, seq, ok)) {
+            queue.unlock ();
+            return ok;
+        }
+        if (! waited && window_usec > 0 && pending (queue.fd) < max_rows) {
+            queue.unlock ();
+            ::usleep (window_usec);
+            waited = true;
+            continue;
+        }
+        std::uint64_t first_seq = 0;
+        std::uint64_t last_seq = 0;
+        bool const taken = take (queue.fd, rows, first_seq, last_seq);
+        if (! queue.unlock () || ! taken)
+            return false;
+        // the row has gone with a leader crashed before finishing.
+        if (rows.empty ())
+            return false;
+        ok = commit (rows);
+        if (! queue.lock ())
+            return false;
+        bool const finished = finish (queue.fd, first_seq, last_seq, ok);
+        if (! queue.unlock () || ! finished)
+            return false;
+    }
+}
+
+bool
+group_commit::read_header (int fd, header_type& header)
+{
+    off_t const size = ::lseek (fd, 0, SEEK_END);
+    if (size < 0)
+        return false;
+    if (0 == size) {
+        std::memset (&header, 0, sizeof (header));
+        std::memcpy (header.magic, MAGIC, sizeof (MAGIC));
+        header.tail = sizeof (header);
+        return true;
+    }
+    return pread_all (fd, &header, sizeof (header), 0)
+        && std::memcmp (header.magic, MAGIC, sizeof (MAGIC)) == 0
+        && header.tail >= sizeof (header);
+}
+
+bool
+group_commit::write_header (int fd, header_type const& header)
+{
+    return pwrite_all (fd, &header, sizeof (header), 0);
+}
+
+// FNV-1a
+std::uint32_t
+group_commit::checksum (char const* s, std::size_t n)
+{
+    std::uint32_t h = 2166136261U;
+    for (std::size_t i = 0; i < n; ++i)
+        h = (h ^ static_cast<unsigned char> (s[i])) * 16777619U;
+    return h;
+}
+
+// record: seq u64, size u32 and checksum u32 of the rest, number of
+// fields u32, and the fields of size u32 and bytes. it is written over
+// whatever a writer dying before its header has left at the tail, and
+// over the one cut off in the file, whose seq is then never taken.
+bool
+group_commit::enqueue (int fd, row_type const& row, std::uint64_t& seq)
+{
+    header_type header;
+    if (! read_header (fd, header))
+        return false;
+    off_t const end = ::lseek (fd, 0, SEEK_END);
+    if (end >= static_cast<off_t> (sizeof (header)) && header.tail > static_cast<std::uint64_t> (end))
+        header.tail = end;
+    std::string fields;
+    put<std::uint32_t> (fields, row.size ());
+    for (auto const& field : row) {
+        put<std::uint32_t> (fields, field.size ());
+        fields += field;
+    }
+    seq = ++header.next_seq;
+    std::string record;
+    put<std::uint64_t> (record, seq);
+    put<std::uint32_t> (record, fields.size ());
+    put<std::uint32_t> (record, checksum (fields.data (), fields.size ()));
+    record += fields;
+    if (! pwrite_all (fd, record.data (), record.size (), header.tail))
+        return false;
+    header.tail += record.size ();
+    return write_header (fd, header);
+}
+
+std::uint64_t
+group_commit::pending (int fd)
+{
+    header_type header;
+    if (! read_header (fd, header))
+        return 0;
+    return header.next_seq - header.done_seq;
+}
+
+// take the oldest max_rows rows out of the queue. the records are read
+// up to the tail, and cut off at the first one out of order or damaged,
+// whose rows are never taken, and so recorded as failed by the finish
+// of a later batch, or by the waiters finding nothing to take.
+bool
+group_commit::take (int fd, std::vector<row_type>& rows,
+                    std::uint64_t& first_seq, std::uint64_t& last_seq)
+{
+    header_type header;
+    if (! read_header (fd, header))
+        return false;
+    rows.clear ();
+    off_t const end = ::lseek (fd, 0, SEEK_END);
+    if (end < static_cast<off_t> (sizeof (header)))
+        return false;
+    std::string buf (std::min<std::uint64_t> (header.tail, end) - sizeof (header), '\0');
+    if (! buf.empty () && ! pread_all (fd, &buf[0], buf.size (), sizeof (header)))
+        return false;
+    std::size_t pos = 0;
+    std::uint64_t prev_seq = header.done_seq;
+    while (pos < buf.size () && rows.size () < max_rows) {
+        std::size_t const at = pos;
+        std::uint64_t seq;
+        std::uint32_t size, sum;
+        if (! get (buf, pos, seq) || ! get (buf, pos, size) || ! get (buf, pos, sum)
+                || seq <= prev_seq || seq > header.next_seq
+                || buf.size () - pos < size || checksum (&buf[pos], size) != sum
+                || ! parse (buf.substr (pos, size), rows)) {
+            buf.resize (at);
+            pos = at;
+            break;
+        }
+        pos += size;
+        if (rows.size () == 1)
+            first_seq = seq;
+        last_seq = prev_seq = seq;
+    }
+    buf.erase (0, pos);
+    header.tail = sizeof (header) + buf.size ();
+    return (buf.empty () || pwrite_all (fd, buf.data (), buf.size (), sizeof (header)))
+        && ::ftruncate (fd, header.tail) == 0
+        && write_header (fd, header);
+}
+
+// the fields of a record onto the rows.
+bool
+group_commit::parse (std::string const& fields, std::vector<row_type>& rows)
+{
+    std::size_t pos = 0;
+    std::uint32_t nfield;
+    if (! get (fields, pos, nfield))
+        return false;
+    row_type row;
+    for (std::uint32_t i = 0; i < nfield; ++i) {
+        std::uint32_t size;
+        if (! get (fields, pos, size) || fields.size () - pos < size)
+            return false;
+        row.push_back (fields.substr (pos, size));
+        pos += size;
+    }
+    if (pos != fields.size ())
+        return false;
+    rows.push_back (row);
+    return true;
+}
+
+// the rows up to last_seq are over. the rows before first_seq not done
+// yet have been taken by a leader crashed before finishing, and are
+// recorded as failed whether the batch has committed or not.
+bool
+group_commit::finish (int fd, std::uint64_t first_seq, std::uint64_t last_seq, bool ok)
+{
+    header_type header;
+    if (! read_header (fd, header))
+        return false;
+    if (! ok)
+        fail (header, header.done_seq + 1, last_seq);
+    else if (header.done_seq + 1 < first_seq)
+        fail (header, header.done_seq + 1, first_seq - 1);
+    header.done_seq = last_seq;
+    return write_header (fd, header);
+}
+
+void
+group_commit::fail (header_type& header, std::uint64_t first_seq, std::uint64_t last_seq)
+{
+    std::uint32_t const i = header.fail_next++ % NFAIL;
+    if (header.fail_next > NFAIL && header.fail_forgotten < header.fail_last[i])
+        header.fail_forgotten = header.fail_last[i];
+    header.fail_first[i] = first_seq;
+    header.fail_last[i] = last_seq;
+}
+
+// has the batch carrying seq been over? ok tells whether it committed.
+// past the last NFAIL failures, the result is unknown and taken as failure.
+bool
+group_commit::done (int fd, std::uint64_t seq, bool& ok)
+{
+    header_type header;
+    if (! read_header (fd, header) || header.done_seq < seq)
+        return false;
+    ok = header.fail_forgotten < seq;
+    for (std::uint32_t i = 0; i < NFAIL && i < header.fail_next; ++i)
+        if (header.fail_first[i] <= seq && seq <= header.fail_last[i])
+            ok = false;
+    return true;
+}
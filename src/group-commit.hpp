@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+/* group commit of rows across processes
+ *
+ *      group_commit queue ("data/suzume", 1000, 64);
+ *      bool ok = queue.submit (row, [&](std::vector<row_type> const& rows) {
+ *          return data.insert (rows);
+ *      });
+ *
+ * submit appends the row to the queue file path.queue and waits for
+ * the leader lock on path.lock. the first waiter getting the lock
+ * becomes the leader: it waits the window for more rows while fewer
+ * than max_rows are pending, takes the pending rows out of the queue
+ * and hands them to commit in one batch. submit returns after the batch
+ * carrying its row has committed, with the result of the commit.
+ *
+ * each submit opens the files by itself, so that the threads in one
+ * process queue up with each other as well as the separate processes.
+ * a record counts once the header has been written after it, so that
+ * the bytes left by a writer dying partway are dropped at the next take.
+ */
+
+class group_commit {
+public:
+    typedef std::vector<std::string> row_type;
+    typedef std::function<bool (std::vector<row_type> const& rows)> commit_type;
+
+    group_commit (std::string const& path, long window_usec, std::size_t max_rows);
+    bool submit (row_type const& row, commit_type const& commit);
+
+private:
+    enum { NFAIL = 8 };
+
+    struct header_type {
+        char magic[8];
+        std::uint64_t next_seq;
+        std::uint64_t done_seq;
+        std::uint64_t fail_first[NFAIL];
+        std::uint64_t fail_last[NFAIL];
+        std::uint64_t fail_forgotten;
+        std::uint32_t fail_next;
+        std::uint32_t reserved;
+        std::uint64_t tail;         // end of the records accounted for
+    };
+
+    bool enqueue (int fd, row_type const& row, std::uint64_t& seq);
+    std::uint64_t pending (int fd);
+    bool take (int fd, std::vector<row_type>& rows,
+               std::uint64_t& first_seq, std::uint64_t& last_seq);
+    bool finish (int fd, std::uint64_t first_seq, std::uint64_t last_seq, bool ok);
+    static void fail (header_type& header, std::uint64_t first_seq, std::uint64_t last_seq);
+    bool done (int fd, std::uint64_t seq, bool& ok);
+    static bool read_header (int fd, header_type& header);
+    static bool write_header (int fd, header_type const& header);
+    static std::uint32_t checksum (char const* s, std::size_t n);
+    static bool parse (std::string const& fields, std::vector<row_type>& rows);
+
+    std::string const queue_path;
+    std::string const lock_path;
+    long const window_usec;
+    std::size_t const max_rows;
+};
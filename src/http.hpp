@@ -4,9 +4,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include "arena.hpp"
 
 namespace http {
 
+// the nodes of the containers of a request live in the arena of the
+// runner, while the strings in them keep their bytes on the heap.
+typedef std::map<std::string,std::string,std::less<std::string>,
+    arena_allocator<std::pair<std::string const,std::string>>> env_type;
+typedef std::vector<std::string,arena_allocator<std::string>> strings_type;
+
 struct content_length_type {
     std::string string;
     std::string status;
@@ -16,59 +23,178 @@ struct content_length_type {
 };
 
 struct request {
-    std::map<std::string,std::string> env;
+    arena* memory;
+    env_type env;
     std::string method;
     std::string content_type;
     content_length_type content_length;
     FILE* input;
-    request ()
-        : env (), method (), content_type (), content_length (), input (nullptr) {}
+    explicit request (arena* a = nullptr)
+        : memory (a), env (std::less<std::string> (), env_type::allocator_type (a)),
+          method (), content_type (), content_length (), input (nullptr) {}
+};
+
+// takes the value of a part as it is read, instead of the parameter.
+struct formdata_sink {
+    virtual ~formdata_sink () {}
+    // the size of the value, told before its first octet.
+    virtual bool reserve (std::size_t size) { return true; }
+    virtual bool write (char const* s, std::size_t n) { return true; }
 };
 
 struct formdata {
-    formdata () : boundary (), parameter (), query_parameter () {}
+    explicit formdata (arena* a = nullptr)
+        : memory (a), boundary (), parameter (strings_type::allocator_type (a)),
+          query_parameter (strings_type::allocator_type (a)) {}
     bool ismultipart (std::string const& content_type);
     bool decode (FILE* in, std::size_t content_length);
+    // the part of stream_name must be the last, and goes to the sink
+    // in chunks without being kept in the parameter.
+    bool decode (FILE* in, std::size_t content_length,
+                 std::string const& stream_name, formdata_sink& sink);
     bool decode_query_string (std::string const& query_string);
+    arena* memory;
     std::string boundary;
-    std::vector<std::string> parameter;
-    std::vector<std::string> query_parameter;
+    strings_type parameter;
+    strings_type query_parameter;
+
+private:
+    bool decode (FILE* in, std::size_t content_length,
+                 std::string const* stream_name, formdata_sink* sink);
+    static bool stream_value (FILE* in, std::size_t size,
+                              std::string const& delimiter, formdata_sink& sink);
 };
 
 struct response {
-    std::vector<std::string> headers;
+    strings_type headers;
     std::string status;
     std::string content_type;
     std::string location;
+    std::string content_encoding;   // of the body, when already encoded
     std::string body;
-    response () : headers (), status ("200 Ok"),
+    std::size_t measured;           // length of the body left out of a HEAD
+    bool head_only;
+    explicit response (arena* a = nullptr) : headers (strings_type::allocator_type (a)), status ("200 Ok"),
         content_type ("text/html; charset=utf-8"),
-        location (), body () {}
+        location (), content_encoding (), body (), measured (0), head_only (false) {}
+
+    // the answer to HEAD of a body measured without being written.
+    void measure (std::size_t size, std::string const& coding)
+    {
+        body.clear ();
+        content_encoding = coding;
+        measured = size;
+        head_only = true;
+    }
+
+    bool not_modified ()
+    {
+        status = "304 Not Modified";
+        location.clear ();
+        content_encoding.clear ();
+        body.clear ();
+        return true;
+    }
 
     bool bad_request ()
     {
         status = "400 Bad Request";
         content_type = "text/html; charset=utf-8";
         location.clear ();
+        content_encoding.clear ();
         body = "<!DOCTYPE html><html><head><title>400 Bad Request</title>"
                "</head><body><h1>400 Bad Request</h1></body></html>";
         return true;
     }
 
+    bool not_found ()
+    {
+        status = "404 Not Found";
+        content_type = "text/html; charset=utf-8";
+        location.clear ();
+        content_encoding.clear ();
+        body = "<!DOCTYPE html><html><head><title>404 Not Found</title>"
+               "</head><body><h1>404 Not Found</h1></body></html>";
+        return true;
+    }
+
+    bool method_not_allowed (std::string const& allow)
+    {
+        status = "405 Method Not Allowed";
+        content_type = "text/html; charset=utf-8";
+        location.clear ();
+        content_encoding.clear ();
+        headers.push_back ("Allow");
+        headers.push_back (allow);
+        body = "<!DOCTYPE html><html><head><title>405 Method Not Allowed</title>"
+               "</head><body><h1>405 Method Not Allowed</h1></body></html>";
+        return true;
+    }
+
     bool internal_server_error ()
     {
         status = "500 Internal Server Error";
         content_type = "text/html; charset=utf-8";
         location.clear ();
+        content_encoding.clear ();
         body = "<!DOCTYPE html><html><head><title>500 Internal Server Error</title>"
                "</head><body><h1>500 Internal Server Error</h1></body></html>";
         return true;
     }
+
+    bool too_many_requests ()
+    {
+        status = "429 Too Many Requests";
+        content_type = "text/html; charset=utf-8";
+        location.clear ();
+        content_encoding.clear ();
+        headers.push_back ("Retry-After");
+        headers.push_back ("10");
+        body = "<!DOCTYPE html><html><head><title>429 Too Many Requests</title>"
+               "</head><body><h1>429 Too Many Requests</h1></body></html>";
+        return true;
+    }
+
+    bool service_unavailable ()
+    {
+        status = "503 Service Unavailable";
+        content_type = "text/html; charset=utf-8";
+        location.clear ();
+        content_encoding.clear ();
+        headers.push_back ("Retry-After");
+        headers.push_back ("1");
+        body = "<!DOCTYPE html><html><head><title>503 Service Unavailable</title>"
+               "</head><body><h1>503 Service Unavailable</h1></body></html>";
+        return true;
+    }
+};
+
+// the content coding to respond with, "gzip", "deflate" or "".
+std::string accept_encoding (env_type const& env);
+bool content_encode (std::string const& coding, std::string const& input, std::string& output);
+
+// the size of a body encoded as content_encode does, the body given in
+// pieces and never kept, nor its encoding.
+class encoded_length {
+public:
+    explicit encoded_length (std::string const& coding);
+    ~encoded_length ();
+    bool good () const { return mz != nullptr; }
+    void write (char const* s, std::size_t n);
+    bool finish (std::size_t& size);
+
+private:
+    struct z_stream_s* mz;
+    bool deflate_out (int flush);
+    encoded_length (encoded_length const&);
+    encoded_length& operator= (encoded_length const&);
 };
 
 struct appl {
     appl () {}
     virtual ~appl () {}
+    // asked before the request body is read, false to refuse it with 429.
+    virtual bool admit (http::request& req) { return true; }
     virtual bool call (http::request& req, http::response& res) { return false; }
 };
 
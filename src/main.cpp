@@ -1,35 +1,329 @@
 #include <cstdlib>
+#include <cstdio>
+#include <algorithm>
 #include <csignal>
 #include <string>
 #include <vector>
+#include "mustache.hpp"
 #include "suzume_data.hpp"
 #include "suzume_view.hpp"
+#include "suzume_cache.hpp"
+#include "group-commit.hpp"
+#include "archive.hpp"
+#include "rate-limit.hpp"
+#include "metrics.hpp"
 #include "http.hpp"
+#include "router.hpp"
+#include "encode-utf8.hpp"
 #include "runcgi.hpp"
 
-enum { POST_LIMIT = 1024 };
+enum { POST_LIMIT = 1024, POST_STREAM_LIMIT = 1024 * 1024 };
+enum { COMMIT_WINDOW_USEC = 1000, COMMIT_MAX_ROWS = 64 };
+enum { PAGE_SIZE = 20, API_LIMIT = 100 };
+enum { READER_POOL = 4 };
+enum { RATE_SLOTS = 4096, POST_PER_MINUTE = 12, POST_BURST = 10 };
 
 struct suzume_appl : public http::appl {
     std::string dbname;
     std::string srcname;
+    sqlite3pp::options dboptions;
+    sqlite3pp::pool readers;
+    archive cold;
+    rate_limit limit;
+    metrics stats;
+    group_commit queue;
+    suzume_cache cache;
+    int page_size;
+    mustache::layout_type layout;
+    bool layout_loaded;
+    http::router<suzume_appl> routes;
 
-    suzume_appl (std::string const& adbname, std::string const& asrcname)
-        : dbname (adbname), srcname (asrcname) {}
+    suzume_appl (std::string const& adbname, std::string const& asrcname,
+                 std::string const& aqueuename, std::string const& acachename,
+                 std::string const& aarchivename, std::string const& alimitname,
+                 std::string const& ametricsname)
+        : dbname (adbname), srcname (asrcname), dboptions (write_options ()),
+          readers (adbname, read_options (), READER_POOL), cold (aarchivename),
+          limit (alimitname, RATE_SLOTS, POST_PER_MINUTE, POST_BURST), stats (ametricsname),
+          queue (aqueuename, COMMIT_WINDOW_USEC, COMMIT_MAX_ROWS),
+          cache (acachename), page_size (PAGE_SIZE), layout (), layout_loaded (false), routes ()
+    {
+        routes.add ("GET", "/", &suzume_appl::get_frontpage);
+        routes.add ("POST", "/", &suzume_appl::post_entry);
+        routes.add ("GET", "/metrics", &suzume_appl::get_metrics);
+        routes.add ("GET", "/api/recents", &suzume_appl::get_recents_json);
+    }
+
+    static sqlite3pp::options write_options ()
+    {
+        sqlite3pp::options opt;
+        opt.journal_mode = "WAL";
+        opt.synchronous = "NORMAL";
+        opt.busy_timeout = 3000;
+        opt.mmap_size = 64L * 1024L * 1024L;
+        return opt;
+    }
+
+    // the pages are read through the memory map shared with the writers.
+    static sqlite3pp::options read_options ()
+    {
+        sqlite3pp::options opt;
+        opt.readonly = true;
+        opt.busy_timeout = 3000;
+        opt.mmap_size = 64L * 1024L * 1024L;
+        return opt;
+    }
 
-    bool get_frontpage (http::request& req, http::response& res)
+    // entries are never modified, so that the newest id and the
+    // template identify each page. it validates the page for the
+    // browsers, and the front page is cached as well. the other pages
+    // and the search results are not cached here. HEAD takes the same
+    // way for the Content-Length, from the cache when it has the page,
+    // or measured by a render writing no body, and the runner leaves out
+    // the body.
+    bool get_frontpage (http::request& req, http::response& res, http::strings_type const&)
     {
-        suzume_data data (dbname);
-        suzume_view view (data, srcname);
+        suzume_cursor page {0, 0, page_size, ""};
+        if (! page_cursor (req, page))
+            return res.bad_request ();
+        sqlite3pp::connection dbh = readers.acquire ();
+        sqlite3pp::lock_stats const before = dbh.stats ();
+        suzume_data data (dbh);
+        data.tier (&cold);
+        std::string tag;
+        sqlite3_int64 const newest = data.newest_id ();
+        std::string const stamp = suzume_view::stamp (srcname);
+        if (! stamp.empty ())
+            tag = std::to_string (newest) + ":" + stamp;
+        // the runner encodes the body with the same coding otherwise.
+        std::string const coding = http::accept_encoding (req.env);
+        if (! tag.empty ()) {
+            std::string const etag = "\"" + tag + (coding.empty () ? "" : "-" + coding) + "\"";
+            res.headers.push_back ("ETag");
+            res.headers.push_back (etag);
+            res.headers.push_back ("Cache-Control");
+            res.headers.push_back ("no-cache");
+            if (etag_match (req, etag)) {
+                release (dbh, before);
+                return res.not_modified ();
+            }
+        }
+        if (page.before > 0 || page.after > 0 || ! page.query.empty ())
+            tag.clear ();
         res.content_type = "text/html; charset=UTF-8";
-        return view.render (res.body);
+        bool ok = true;
+        if (! coding.empty () && cache.load (tag, res.body, coding))
+            res.content_encoding = coding;
+        else if (cache.load (tag, res.body))
+            encode (tag, coding, res);
+        else if (req.method == "HEAD")
+            ok = measure (data, page, newest, coding, res);
+        else if ((ok = render (data, page, newest, tag, res)))
+            encode (tag, coding, res);
+        release (dbh, before);
+        return ok;
+    }
+
+    // the pooled connection counts the waits since it was opened.
+    void release (sqlite3pp::connection& dbh, sqlite3pp::lock_stats const& before)
+    {
+        sqlite3pp::lock_stats const& after = dbh.stats ();
+        stats.lock (after.busy - before.busy, after.timeout - before.timeout,
+                    after.wait_usec - before.wait_usec);
+        readers.release (dbh);
+    }
+
+    // the front page is compressed once for each coding and kept.
+    void encode (std::string const& tag, std::string const& coding, http::response& res)
+    {
+        std::string encoded;
+        if (tag.empty () || coding.empty () || ! http::content_encode (coding, res.body, encoded))
+            return;
+        cache.store (tag, encoded, coding);
+        res.body.swap (encoded);
+        res.content_encoding = coding;
+    }
+
+    // If-None-Match: "*" or a list of the entity tags, weak or strong.
+    static bool etag_match (http::request& req, std::string const& etag)
+    {
+        auto const it = req.env.find ("HTTP_IF_NONE_MATCH");
+        if (it == req.env.end ())
+            return false;
+        std::string const& field = it->second;
+        for (std::size_t pos = 0; pos < field.size (); ) {
+            std::size_t const comma = std::min (field.find (',', pos), field.size ());
+            std::size_t first = field.find_first_not_of (" \t", pos);
+            std::size_t last = comma;
+            while (last > first && (' ' == field[last - 1] || '\t' == field[last - 1]))
+                --last;
+            if (first < last && field.compare (first, 2, "W/") == 0)
+                first += 2;
+            if (first < last && (field.compare (first, last - first, etag) == 0
+                    || field.compare (first, last - first, "*") == 0))
+                return true;
+            pos = comma + 1;
+        }
+        return false;
+    }
+
+    // the fragments cached in the layout are keyed only when it has been
+    // kept from an earlier request, for a layout loaded for this one
+    // alone never sees them again.
+    bool render (suzume_data& data, suzume_cursor const& page, sqlite3_int64 newest,
+                 std::string const& tag, http::response& res)
+    {
+        bool const kept = layout_loaded;
+        if (! layout_loaded && ! (layout_loaded = suzume_view::load (layout, srcname)))
+            return false;
+        suzume_view view (data, page, kept ? newest : 0);
+        {
+            metrics::timer t (stats, metrics::RENDER);
+            view.render (layout, res.body);
+        }
+        cache.store (tag, res.body);
+        return true;
+    }
+
+    // counts the length of the page, and of its encoding if any.
+    struct length_sink : public mustache::output_sink {
+        std::size_t size;
+        http::encoded_length encoded;
+        explicit length_sink (std::string const& coding) : size (0), encoded (coding) {}
+        void write (char const* s, std::size_t n)
+        {
+            size += n;
+            encoded.write (s, n);
+        }
+    };
+
+    // the page is rendered as for GET, but into the sink only. the
+    // length is of the encoding when the coding has been negotiated,
+    // and of the page as it is when the encoding fails as in encode.
+    bool measure (suzume_data& data, suzume_cursor const& page, sqlite3_int64 newest,
+                  std::string const& coding, http::response& res)
+    {
+        bool const kept = layout_loaded;
+        if (! layout_loaded && ! (layout_loaded = suzume_view::load (layout, srcname)))
+            return false;
+        suzume_view view (data, page, kept ? newest : 0);
+        length_sink sink (coding);
+        {
+            metrics::timer t (stats, metrics::RENDER);
+            view.render (layout, sink);
+        }
+        std::size_t size;
+        if (! coding.empty () && sink.encoded.finish (size))
+            res.measure (size, coding);
+        else
+            res.measure (sink.size, "");
+        return true;
+    }
+
+    // {"entries":[{"id":9,"body":"..."},...],"newer":9,"older":8}
+    // the bodies are written into the response as the rows are stepped.
+    // newer and older are the ids for ?after= and ?before= of the next
+    // polls, or null when there is nothing beyond them.
+    bool get_recents_json (http::request& req, http::response& res, http::strings_type const&)
+    {
+        suzume_cursor page {0, 0, page_size, ""};
+        if (! page_cursor (req, page, API_LIMIT) || ! page.query.empty ())
+            return res.bad_request ();
+        sqlite3pp::connection dbh = readers.acquire ();
+        sqlite3pp::lock_stats const before = dbh.stats ();
+        suzume_data data (dbh);
+        data.tier (&cold);
+        res.content_type = "application/json; charset=utf-8";
+        res.body = "{\"entries\":[";
+        sqlite3_int64 newest = 0;
+        sqlite3_int64 oldest = 0;
+        data.recents_iter (page);
+        while (data.recents_step ()) {
+            char const* first;
+            char const* last;
+            oldest = data.recents_id ();
+            if (newest == 0)
+                newest = oldest;
+            else
+                res.body += ',';
+            res.body += "{\"id\":" + std::to_string (oldest) + ",\"body\":\"";
+            data.recents_body (first, last);
+            wjson::escape_json (first, last, res.body);
+            res.body += "\"}";
+        }
+        bool const newer = newest > 0 && data.has_newer (newest);
+        bool const older = oldest > 0 && data.has_older (oldest);
+        res.body += "],\"newer\":" + (newer ? std::to_string (newest) : "null")
+            + ",\"older\":" + (older ? std::to_string (oldest) : "null") + "}";
+        release (dbh, before);
+        return true;
     }
 
-    bool post_body (std::vector<std::string>& param, http::request& req, http::response& res)
+    // ?before=<id> or ?after=<id> selects a page other than the front,
+    // and ?q=<words> searches the entries. ?limit=<n> sets the page size
+    // up to max_limit, if it is given.
+    // a page is either before an id or after one, never between two.
+    static bool page_cursor (http::request& req, suzume_cursor& page, int max_limit = 0)
+    {
+        auto const it = req.env.find ("QUERY_STRING");
+        if (it == req.env.end () || it->second.empty ())
+            return true;
+        http::formdata query (req.memory);
+        if (! query.decode_query_string (it->second))
+            return false;
+        http::strings_type const& param = query.query_parameter;
+        bool before = false;
+        bool after = false;
+        for (std::size_t i = 0; i + 1 < param.size (); i += 2) {
+            if (param[i] == "before" && ! (before = entry_id (param[i + 1], page.before)))
+                return false;
+            else if (param[i] == "after" && ! (after = entry_id (param[i + 1], page.after)))
+                return false;
+            else if (param[i] == "q")
+                page.query = param[i + 1];
+            else if (param[i] == "limit" && max_limit > 0) {
+                sqlite3_int64 limit;
+                if (! entry_id (param[i + 1], limit) || limit < 1 || max_limit < limit)
+                    return false;
+                page.limit = static_cast<int> (limit);
+            }
+        }
+        return ! (before && after);
+    }
+
+    static bool entry_id (std::string const& str, sqlite3_int64& id)
+    {
+        if (str.empty () || str.size () > 18)
+            return false;
+        id = 0;
+        for (char const c : str) {
+            if (c < '0' || '9' < c)
+                return false;
+            id = id * 10 + (c - '0');
+        }
+        return true;
+    }
+
+    bool post_body (http::strings_type& param, http::request& req, http::response& res)
     {
-        suzume_data data (dbname);
         for (auto it = param.begin (); it != param.end (); it += 2) {
             if (it[0] == "body") {
-                data.insert (it[1]);
+                if (! suzume_view::postable (it[1].data (), it[1].data () + it[1].size ()))
+                    return res.bad_request ();
+                std::string html;
+                suzume_view::escape (it[1], html);
+                // the posts queued meanwhile are inserted in one transaction.
+                metrics::timer t (stats, metrics::COMMIT);
+                bool const ok = queue.submit ({it[1], html},
+                    [this](std::vector<group_commit::row_type> const& rows) {
+                        suzume_data data (dbname, dboptions);
+                        bool const done = data.insert (rows);
+                        sqlite3pp::lock_stats const& s = data.lock_stats ();
+                        stats.lock (s.busy, s.timeout, s.wait_usec);
+                        return done;
+                    });
+                if (! ok)
+                    return res.service_unavailable ();
                 res.status = "303";
                 res.location = "suzume.cgi";
                 return true;
@@ -38,22 +332,86 @@ struct suzume_appl : public http::appl {
         return res.bad_request ();
     }
 
-    bool call (http::request& req, http::response& res)
+    bool get_metrics (http::request&, http::response& res, http::strings_type const&)
     {
-        if (req.method == "GET") {
-            return get_frontpage (req, res);
+        res.content_type = "text/plain; version=0.0.4; charset=utf-8";
+        stats.exposition (res.body);
+        return true;
+    }
+
+    // the posts of each client address are limited to a burst and a rate.
+    bool admit (http::request& req)
+    {
+        if (req.method != "POST")
+            return true;
+        auto const it = req.env.find ("REMOTE_ADDR");
+        return it == req.env.end () || limit.admit (it->second);
+    }
+
+    bool post_entry (http::request& req, http::response& res, http::strings_type const&)
+    {
+        if (! req.content_length.le (POST_STREAM_LIMIT))
+            return res.bad_request ();
+        http::formdata formdata (req.memory);
+        if (! formdata.ismultipart (req.content_type))
+            return res.bad_request ();
+        if (! req.content_length.le (POST_LIMIT))
+            return post_stream (formdata, req, res);
+        if (! formdata.decode (req.input, req.content_length.to_size ()))
+            return res.bad_request ();
+        return post_body (formdata.parameter, req, res);
+    }
+
+    // the body of a long post is spooled into a temporary file by the
+    // decoder as it is read from the client.
+    struct spool_sink : public http::formdata_sink {
+        std::FILE* file;
+        std::size_t size;
+        bool reserved;
+        spool_sink () : file (std::tmpfile ()), size (0), reserved (false) {}
+        ~spool_sink () { if (file != nullptr) std::fclose (file); }
+        bool reserve (std::size_t n)
+        {
+            size = n;
+            reserved = file != nullptr;
+            return reserved;
         }
-        else if (req.method == "POST") {
-            if (! req.content_length.le (POST_LIMIT))
-                return res.bad_request ();
-            http::formdata formdata;
-            if (! formdata.ismultipart (req.content_type))
-                return res.bad_request ();
-            if (! formdata.decode (req.input, req.content_length.to_size ()))
-                return res.bad_request ();
-            return post_body (formdata.parameter, req, res);
+        bool write (char const* s, std::size_t n)
+        {
+            return suzume_view::postable (s, s + n) && std::fwrite (s, 1, n, file) == n;
         }
-        return res.bad_request ();
+    };
+
+    // the long posts are inserted one by one, not through the queue,
+    // which would keep the body in memory. the write lock is taken after
+    // the whole body has arrived, so that a slow client cannot hold it,
+    // and the body goes from the map of the spool into its row.
+    bool post_stream (http::formdata& formdata, http::request& req, http::response& res)
+    {
+        spool_sink sink;
+        if (! formdata.decode (req.input, req.content_length.to_size (), "body", sink)
+                || ! sink.reserved)
+            return res.bad_request ();
+        if (std::fflush (sink.file) != 0)
+            return res.internal_server_error ();
+        // the body shorter than it has been reserved for
+        if (std::ftell (sink.file) != static_cast<long> (sink.size))
+            return res.bad_request ();
+        metrics::timer t (stats, metrics::COMMIT);
+        suzume_data data (dbname, dboptions);
+        bool const ok = data.insert (sink.file, sink.size);
+        sqlite3pp::lock_stats const& s = data.lock_stats ();
+        stats.lock (s.busy, s.timeout, s.wait_usec);
+        if (! ok)
+            return res.service_unavailable ();
+        res.status = "303";
+        res.location = "suzume.cgi";
+        return true;
+    }
+
+    bool call (http::request& req, http::response& res)
+    {
+        return routes.dispatch (*this, req, res);
     }
 };
 
@@ -61,8 +419,11 @@ int main ()
 {
     std::signal (SIGPIPE, SIG_IGN);
 
-    suzume_appl  app ("data/suzume.db", "view/suzume.html");
-    runcgi (app);
+    suzume_appl  app ("data/suzume.db", "view/suzume.html",
+                      "data/suzume", "data/suzume.cache", "data/archive",
+                      "/dev/shm/suzume-ratelimit", "/dev/shm/suzume-metrics");
+    access_log log ("data/suzume.access");
+    runcgi (app, &app.stats, &log);
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,175 @@
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "metrics.hpp"
+
+static const char MAGIC[8] = {'s', 'u', 'z', 'u', 'm', 'e', 'M', '1'};
+static const char* const METHOD[] = {"GET", "POST", "HEAD", "OTHER"};
+static const char* const PHASE[] = {"total", "call", "render", "commit"};
+
+metrics::metrics (std::string const& path)
+    : mtable (nullptr), mlast ()
+{
+    int const fd = ::open (path.c_str (), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return;
+    struct stat st;
+    // a new file is extended with zeros, that is, with the counters cleared.
+    bool const ok = ::fstat (fd, &st) == 0
+        && (static_cast<std::size_t> (st.st_size) == sizeof (table_type)
+            || (0 == st.st_size && ::ftruncate (fd, sizeof (table_type)) == 0));
+    if (ok) {
+        void* p = ::mmap (nullptr, sizeof (table_type), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED != p)
+            mtable = static_cast<table_type*> (p);
+    }
+    ::close (fd);
+    if (mtable != nullptr && std::memcmp (mtable->magic, MAGIC, sizeof (MAGIC)) != 0) {
+        char const zero[sizeof (MAGIC)] = {0};
+        if (std::memcmp (mtable->magic, zero, sizeof (zero)) != 0) {
+            ::munmap (mtable, sizeof (table_type));
+            mtable = nullptr;
+            return;
+        }
+        std::memcpy (mtable->magic, MAGIC, sizeof (MAGIC));
+    }
+}
+
+metrics::~metrics ()
+{
+    if (mtable != nullptr)
+        ::munmap (mtable, sizeof (table_type));
+}
+
+void
+metrics::request (std::string const& method, int status, std::uint64_t bytes_in, std::uint64_t bytes_out)
+{
+    if (mtable == nullptr)
+        return;
+    int m = 0;
+    while (m < NMETHOD - 1 && method != METHOD[m])
+        ++m;
+    if (MIN_STATUS <= status && status < MIN_STATUS + NSTATUS)
+        add (mtable->requests[m][status - MIN_STATUS], 1);
+    add (mtable->bytes_in, bytes_in);
+    add (mtable->bytes_out, bytes_out);
+}
+
+void
+metrics::latency (int phase, std::uint64_t usec)
+{
+    if (phase < 0 || NPHASE <= phase)
+        return;
+    mlast[phase] = usec;
+    if (mtable == nullptr)
+        return;
+    int i = 0;
+    while (i < NBUCKET - 1 && usec > (std::uint64_t (16) << i))
+        ++i;
+    add (mtable->bucket[phase][i], 1);
+    add (mtable->sum_usec[phase], usec);
+    add (mtable->count[phase], 1);
+}
+
+void
+metrics::begin ()
+{
+    for (int p = 0; p < NPHASE; ++p)
+        mlast[p] = 0;
+}
+
+void
+metrics::lock (std::uint64_t busy, std::uint64_t timeout, std::uint64_t wait_usec)
+{
+    if (mtable == nullptr)
+        return;
+    add (mtable->busy, busy);
+    add (mtable->busy_timeout, timeout);
+    add (mtable->busy_wait_usec, wait_usec);
+}
+
+// the text exposition format of Prometheus, version 0.0.4.
+void
+metrics::exposition (std::string& output) const
+{
+    if (mtable == nullptr)
+        return;
+    char buf[160];
+    output += "# TYPE suzume_requests_total counter\n";
+    for (int m = 0; m < NMETHOD; ++m)
+        for (int s = 0; s < NSTATUS; ++s) {
+            std::uint64_t const n = get (mtable->requests[m][s]);
+            if (0 == n)
+                continue;
+            std::snprintf (buf, sizeof (buf),
+                "suzume_requests_total{method=\"%s\",code=\"%d\"} %llu\n",
+                METHOD[m], MIN_STATUS + s, static_cast<unsigned long long> (n));
+            output += buf;
+        }
+    std::snprintf (buf, sizeof (buf),
+        "# TYPE suzume_request_bytes_total counter\nsuzume_request_bytes_total %llu\n"
+        "# TYPE suzume_response_bytes_total counter\nsuzume_response_bytes_total %llu\n",
+        static_cast<unsigned long long> (get (mtable->bytes_in)),
+        static_cast<unsigned long long> (get (mtable->bytes_out)));
+    output += buf;
+    std::snprintf (buf, sizeof (buf),
+        "# TYPE suzume_sqlite_busy_total counter\nsuzume_sqlite_busy_total %llu\n"
+        "# TYPE suzume_sqlite_busy_timeouts_total counter\nsuzume_sqlite_busy_timeouts_total %llu\n",
+        static_cast<unsigned long long> (get (mtable->busy)),
+        static_cast<unsigned long long> (get (mtable->busy_timeout)));
+    output += buf;
+    std::snprintf (buf, sizeof (buf),
+        "# TYPE suzume_sqlite_busy_wait_seconds_total counter\n"
+        "suzume_sqlite_busy_wait_seconds_total %.6f\n",
+        get (mtable->busy_wait_usec) / 1e6);
+    output += buf;
+    output += "# TYPE suzume_phase_duration_seconds histogram\n";
+    for (int p = 0; p < NPHASE; ++p) {
+        std::uint64_t cumulative = 0;
+        for (int i = 0; i < NBUCKET; ++i) {
+            cumulative += get (mtable->bucket[p][i]);
+            if (i < NBUCKET - 1)
+                std::snprintf (buf, sizeof (buf),
+                    "suzume_phase_duration_seconds_bucket{phase=\"%s\",le=\"%.6f\"} %llu\n",
+                    PHASE[p], (std::uint64_t (16) << i) / 1e6,
+                    static_cast<unsigned long long> (cumulative));
+            else
+                std::snprintf (buf, sizeof (buf),
+                    "suzume_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n",
+                    PHASE[p], static_cast<unsigned long long> (cumulative));
+            output += buf;
+        }
+        std::snprintf (buf, sizeof (buf),
+            "suzume_phase_duration_seconds_sum{phase=\"%s\"} %.6f\n"
+            "suzume_phase_duration_seconds_count{phase=\"%s\"} %llu\n",
+            PHASE[p], get (mtable->sum_usec[p]) / 1e6,
+            PHASE[p], static_cast<unsigned long long> (get (mtable->count[p])));
+        output += buf;
+    }
+}
+
+std::uint64_t
+metrics::now_usec ()
+{
+    struct timespec ts;
+    ::clock_gettime (CLOCK_MONOTONIC, &ts);
+    return static_cast<std::uint64_t> (ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void
+metrics::add (std::uint64_t& counter, std::uint64_t n)
+{
+    __atomic_fetch_add (&counter, n, __ATOMIC_RELAXED);
+}
+
+std::uint64_t
+metrics::get (std::uint64_t const& counter)
+{
+    return __atomic_load_n (&counter, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+/* counters and latency histograms shared by the processes
+ *
+ *      metrics stats ("/dev/shm/suzume-metrics");
+ *      {
+ *          metrics::timer t (stats, metrics::RENDER);
+ *          view.render (layout, res.body);
+ *      }
+ *      stats.request ("GET", 200, 0, res.body.size ());
+ *      stats.exposition (res.body);    // Prometheus text format
+ *
+ * the counters live in a file mapped shared, and are added to with
+ * relaxed atomics, so that all the CGI processes count into the same
+ * place without a lock. the latencies are counted in the buckets of
+ * the powers of two microseconds. when the file cannot be mapped,
+ * nothing is counted.
+ */
+
+class metrics {
+public:
+    enum { TOTAL, CALL, RENDER, COMMIT, NPHASE };
+
+    explicit metrics (std::string const& path);
+    ~metrics ();
+    void request (std::string const& method, int status, std::uint64_t bytes_in, std::uint64_t bytes_out);
+    void latency (int phase, std::uint64_t usec);
+    void lock (std::uint64_t busy, std::uint64_t timeout, std::uint64_t wait_usec);
+    void exposition (std::string& output) const;
+    // the latency of the phase last measured since the request began.
+    void begin ();
+    std::uint64_t last (int phase) const { return mlast[phase]; }
+    static std::uint64_t now_usec ();
+
+    // measures the phase from its construction to its destruction.
+    class timer {
+    public:
+        timer (metrics& a, int b) : stats (a), phase (b), start (now_usec ()) {}
+        ~timer () { stats.latency (phase, now_usec () - start); }
+    private:
+        metrics& stats;
+        int const phase;
+        std::uint64_t const start;
+    };
+
+private:
+    enum { NMETHOD = 4, MIN_STATUS = 100, NSTATUS = 500, NBUCKET = 24 };
+
+    struct table_type {
+        char magic[8];
+        std::uint64_t requests[NMETHOD][NSTATUS];
+        std::uint64_t bytes_in;
+        std::uint64_t bytes_out;
+        std::uint64_t busy;
+        std::uint64_t busy_timeout;
+        std::uint64_t busy_wait_usec;
+        std::uint64_t bucket[NPHASE][NBUCKET];  // upper bounds 2^(i+4) usec, last +Inf
+        std::uint64_t sum_usec[NPHASE];
+        std::uint64_t count[NPHASE];
+    };
+
+    static void add (std::uint64_t& counter, std::uint64_t n);
+    static std::uint64_t get (std::uint64_t const& counter);
+
+    table_type* mtable;
+    std::uint64_t mlast[NPHASE];
+
+    metrics (metrics const&);
+    metrics& operator= (metrics const&);
+};
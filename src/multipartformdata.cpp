@@ -2,17 +2,19 @@
 #include <vector>
 #include <cstdio>
 #include <utility>
+#include <algorithm>
+#include <cstring>
 #include "http.hpp"
 #include "encode-utf8.hpp"
 
 namespace http {
 
 struct media_type {
-    media_type () : type (), parameter () {}
+    explicit media_type (arena* a) : type (), parameter (strings_type::allocator_type (a)) {}
     bool match (std::string const& fieldvalue);
     std::size_t assoc (std::string const& attribute);
     std::string type;
-    std::vector<std::string> parameter;
+    strings_type parameter;
 };
 
 std::size_t
@@ -98,9 +100,9 @@ media_type::match (std::string const& fieldvalue)
 }
 
 static std::string
-disposition_name (std::string const& disposition)
+disposition_name (std::string const& disposition, arena* memory)
 {
-    media_type media;
+    media_type media (memory);
     if (media.match (disposition)) {
         if (media.assoc ("filename") > 0)
             return "";
@@ -121,7 +123,7 @@ matchtail (std::string const &s, std::string const &t)
 bool
 formdata::ismultipart (std::string const& content_type)
 {
-    media_type media;
+    media_type media (memory);
     if (! media.match (content_type)) {
         return false;
     }
@@ -138,6 +140,20 @@ formdata::ismultipart (std::string const& content_type)
 
 bool
 formdata::decode (FILE* in, std::size_t content_length)
+{
+    return decode (in, content_length, nullptr, nullptr);
+}
+
+bool
+formdata::decode (FILE* in, std::size_t content_length,
+                  std::string const& stream_name, formdata_sink& sink)
+{
+    return decode (in, content_length, &stream_name, &sink);
+}
+
+bool
+formdata::decode (FILE* in, std::size_t content_length,
+                  std::string const* stream_name, formdata_sink* sink)
 {
     static const char CODE[] =
         "@@@@@@@@@CF@@D@@@@@@@@@@@@@@@@@@CAEAAAAAEEAAEAAEAAAAAAAAAABEEEEE"
@@ -180,13 +196,27 @@ formdata::decode (FILE* in, std::size_t content_length)
                 break;
             case 0x300U:
                 if (fieldname == "content-disposition" && name.empty ())
-                    name = disposition_name (fieldvalue);
+                    name = disposition_name (fieldvalue, memory);
                 fieldname.clear ();
                 fieldvalue.clear ();
                 if (1 == code)
                     fieldname.push_back (lowercase (ch));
                 break;
             }
+            // the streamed part ends right before the close delimiter.
+            if (8 == next_state && sink != nullptr && name == *stream_name) {
+                std::size_t const rest = content_length - count;
+                std::string tail (close_delimiter.size (), '\0');
+                next_state = 0;
+                if (rest >= tail.size ()
+                        && stream_value (in, rest - tail.size (),
+                                         delimiter.substr (0, delimiter.size () - CRLF.size ()), *sink)
+                        && std::fread (&tail[0], 1, tail.size (), in) == tail.size ()
+                        && tail == close_delimiter)
+                    next_state = 11;
+                count = next_state == 11 ? content_length : count;
+                break;
+            }
         }
         else if (8 == next_state) {
             body.push_back (ch);
@@ -237,4 +267,50 @@ formdata::decode (FILE* in, std::size_t content_length)
     return 11 == next_state && count == content_length;
 }
 
+// the octets at the end of a chunk that begin a sequence not complete yet.
+static std::size_t
+utf8_incomplete (char const* first, char const* last)
+{
+    for (std::size_t i = 1; i <= 3 && i <= static_cast<std::size_t> (last - first); ++i) {
+        unsigned int const octet = static_cast<unsigned char> (last[-i]);
+        if (0x80U == (0xc0U & octet))
+            continue;
+        std::size_t const length = octet >= 0xf0U ? 4 : octet >= 0xe0U ? 3 : octet >= 0xc0U ? 2 : 1;
+        return length > i ? i : 0;
+    }
+    return 0;
+}
+
+// the tail of the previous chunk is kept in front of the next one, so
+// that a delimiter or a UTF-8 sequence across them is found.
+bool
+formdata::stream_value (FILE* in, std::size_t size,
+                        std::string const& delimiter, formdata_sink& sink)
+{
+    enum { CHUNK = 4096, KEEP = 128 };
+    char buf[KEEP + CHUNK];
+    if (delimiter.size () > KEEP || ! sink.reserve (size))
+        return false;
+    std::size_t kept = 0;
+    std::size_t pending = 0;
+    while (size > 0) {
+        std::size_t const n = std::fread (buf + kept, 1, std::min<std::size_t> (size, CHUNK), in);
+        if (n == 0)
+            return false;
+        size -= n;
+        char const* const first = buf;
+        char const* const last = buf + kept + n;
+        char const* const cut = size > 0 ? last - utf8_incomplete (buf + kept, last) : last;
+        if (std::search (first, last, delimiter.begin (), delimiter.end ()) != last
+                || ! wjson::verify_utf8 (buf + kept - pending, cut)
+                || ! sink.write (buf + kept, n))
+            return false;
+        pending = last - cut;
+        std::size_t const keep = std::min<std::size_t> (delimiter.size () - 1, kept + n);
+        std::memmove (buf, last - keep, keep);
+        kept = keep;
+    }
+    return true;
+}
+
 }//namespace http
@@ -4,6 +4,7 @@
 #include <memory>
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 #include "mustache.hpp"
 #include "taptests.hpp"
 
@@ -19,6 +20,11 @@ void test_nonempty_list (test::simple& ts);
 void test_non_false_values (test::simple& ts);
 void test_inverted_sections (test::simple& ts);
 void test_comments (test::simple& ts);
+void test_binding_table (test::simple& ts);
+void test_batch (test::simple& ts);
+void test_cache (test::simple& ts);
+void test_minify (test::simple& ts);
+void test_striter_pointer (test::simple& ts);
 
 int
 main (int argc, char* argv[])
@@ -34,6 +40,11 @@ main (int argc, char* argv[])
     test_non_false_values (ts);
     test_inverted_sections (ts);
     test_comments (ts);
+    test_binding_table (ts);
+    test_batch (ts);
+    test_cache (ts);
+    test_minify (ts);
+    test_striter_pointer (ts);
     return ts.done_testing ();
 }
 
@@ -497,3 +508,323 @@ test_comments (test::simple& ts)
     layout.expand (page, got);
     ts.ok (got == expected, "Comments expand");
 }
+
+void
+test_binding_table (test::simple& ts)
+{
+    class page_type : public mustache::page_base {
+    public:
+        enum { NKEY = 300 };
+
+        void bind (mustache::layout_type& layout)
+        {
+            for (int i = 0; i < NKEY; ++i)
+                layout.bind ("k" + std::to_string (i), i, mustache::INTEGER);
+        }
+
+        void valueof (int symbol, long& v)
+        {
+            v = symbol * 10L;
+        }
+    };
+
+    std::string src;
+    std::string expected;
+    for (int i = page_type::NKEY - 1; i >= 0; i -= 7) {
+        src += "{{k" + std::to_string (i) + "}},";
+        expected += std::to_string (i * 10L) + ",";
+    }
+    src += "{{k}}{{k3000}}{{k2}}";
+    expected += "20";
+
+    mustache::layout_type layout;
+    page_type page;
+    page.bind (layout);
+    ts.ok (layout.assemble (src), "binding table assemble");
+    std::string got;
+    layout.expand (page, got);
+    ts.ok (got == expected, "binding table expand");
+
+    layout.bind ("k", 7, mustache::INTEGER);
+    ts.ok (layout.assemble (src), "binding table rebind assemble");
+    got.clear ();
+    layout.expand (page, got);
+    ts.ok (got == expected.substr (0, expected.size () - 2) + "7020",
+        "binding table rebind expand");
+
+    ts.ok (! layout.bind ("k2", 9, mustache::INTEGER), "binding table duplicate refused");
+    ts.ok (layout.assemble (src), "binding table duplicate assemble");
+    got.clear ();
+    layout.expand (page, got);
+    ts.ok (got == expected.substr (0, expected.size () - 2) + "7020",
+        "binding table duplicate keeps the first");
+}
+
+void
+test_batch (test::simple& ts)
+{
+    class page_type : public mustache::page_base {
+    public:
+        enum { REPO, NAME, OWNER, EMPTY, TITLE };
+
+        void bind (mustache::layout_type& layout)
+        {
+            layout.bind ("repo",  REPO,  mustache::FOR);
+            layout.bind ("name",  NAME,  mustache::STRING);
+            layout.bind ("owner", OWNER, mustache::STRING);
+            layout.bind ("empty", EMPTY, mustache::FOR);
+            layout.bind ("title", TITLE, mustache::STRING);
+        }
+
+        bool batch (int symbol, mustache::column_block& block)
+        {
+            static char const* const REPO_ROWS[] = {
+                "resque", "defunkt", "hub", "<github>", "rip", "defunkt",
+            };
+            block.clear ();
+            if (REPO == symbol) {
+                block.symbol = {NAME, OWNER};
+                for (char const* cell : REPO_ROWS)
+                    block.push_back (cell, std::strlen (cell));
+                return true;
+            }
+            if (EMPTY == symbol) {
+                block.symbol = {NAME};
+                return true;
+            }
+            return false;
+        }
+
+        void valueof (int symbol, std::string& v)
+        {
+            if (TITLE == symbol) v = "repos";
+        }
+    };
+
+    std::string src (R"EOS(
+{{#repo}}
+  <b>{{name}}</b> by {{owner}} in {{title}}
+{{/repo}}
+{{#empty}}
+  Never shown!
+{{/empty}}
+{{^empty}}
+  No repos :(
+{{/empty}}
+    )EOS");
+    trim_bang (src);
+
+    std::string expected (R"EOS(
+  <b>resque</b> by defunkt in repos
+  <b>hub</b> by &lt;github&gt; in repos
+  <b>rip</b> by defunkt in repos
+  No repos :(
+    )EOS");
+    trim_bang (expected);
+
+    mustache::layout_type layout;
+    page_type page;
+    page.bind (layout);
+    ts.ok (layout.assemble (src), "batch assemble");
+    std::string got;
+    layout.expand (page, got);
+    ts.ok (got == expected, "batch expand");
+}
+
+void
+test_cache (test::simple& ts)
+{
+    class page_type : public mustache::page_base {
+    public:
+        enum { FRAGMENT, NAME };
+        std::string key;
+        std::string name;
+        int count;
+
+        page_type () : key (), name (), count (0) {}
+
+        void bind (mustache::layout_type& layout)
+        {
+            layout.bind ("fragment", FRAGMENT, mustache::CACHE);
+            layout.bind ("name",     NAME,     mustache::STRING);
+        }
+
+        void valueof (int symbol, std::string& v)
+        {
+            if (FRAGMENT == symbol) v = key;
+            else if (NAME == symbol) {
+                ++count;
+                v = name;
+            }
+        }
+    };
+
+    std::string src (R"EOS(
+<p>{{name}}</p>
+{{#fragment}}
+<p>cached {{name}}</p>
+{{/fragment}}
+    )EOS");
+    trim_bang (src);
+
+    mustache::layout_type layout;
+    page_type page;
+    page.bind (layout);
+    ts.ok (layout.assemble (src), "cache assemble");
+
+    std::string got;
+    page.key = "1";
+    page.name = "Chris";
+    layout.expand (page, got);
+    ts.ok (got == "<p>Chris</p>\n<p>cached Chris</p>\n" && 2 == page.count,
+        "cache first expand");
+
+    got.clear ();
+    page.name = "Jon";
+    layout.expand (page, got);
+    ts.ok (got == "<p>Jon</p>\n<p>cached Chris</p>\n" && 3 == page.count,
+        "cache same key");
+
+    got.clear ();
+    page.key = "2";
+    layout.expand (page, got);
+    ts.ok (got == "<p>Jon</p>\n<p>cached Jon</p>\n" && 5 == page.count,
+        "cache new key");
+
+    got.clear ();
+    page.key = "";
+    page.name = "Jack";
+    layout.expand (page, got);
+    ts.ok (got == "<p>Jack</p>\n<p>cached Jack</p>\n" && 7 == page.count,
+        "cache empty key");
+
+    // a sink takes the fragment cached, and leaves a new one uncached.
+    struct string_sink : public mustache::output_sink {
+        std::string bytes;
+        std::size_t nwrite;
+        string_sink () : bytes (), nwrite (0) {}
+        void write (char const* s, std::size_t n) { bytes.append (s, n); ++nwrite; }
+    };
+    string_sink sink;
+    page.key = "2";
+    layout.expand (page, sink);
+    ts.ok (sink.bytes == "<p>Jack</p>\n<p>cached Jon</p>\n" && 8 == page.count
+        && sink.nwrite > 1, "cache same key into sink");
+
+    sink.bytes.clear ();
+    page.key = "3";
+    layout.expand (page, sink);
+    got.clear ();
+    layout.expand (page, got);
+    ts.ok (sink.bytes == "<p>Jack</p>\n<p>cached Jack</p>\n" && got == sink.bytes
+        && 12 == page.count, "cache new key into sink not cached");
+}
+
+void
+test_minify (test::simple& ts)
+{
+    class page_type : public mustache::page_base {
+    public:
+        enum { REPO, NAME };
+        int repo_idx;
+
+        page_type () : repo_idx (0) {}
+
+        void bind (mustache::layout_type& layout)
+        {
+            layout.bind ("repo", REPO, mustache::FOR);
+            layout.bind ("name", NAME, mustache::STRING);
+        }
+
+        void iter (int symbol) { if (REPO == symbol) repo_idx = 0; }
+        void next (int symbol) { if (REPO == symbol) ++repo_idx; }
+
+        void valueof (int symbol, bool& v)
+        {
+            if (REPO == symbol) v = repo_idx < 2;
+        }
+
+        void valueof (int symbol, std::string& v)
+        {
+            if (NAME == symbol) v = 0 == repo_idx ? "hub" : "rip";
+        }
+    };
+
+    std::string src (R"EOS(
+<ul>
+  {{#repo}}
+  <li>  <b>{{name}}</b>  </li>
+  {{/repo}}
+</ul>
+<PRE>
+  keep   {{name}}
+</PRE>
+<p>a  b</p>
+<textarea>
+  x  </textarea>
+    )EOS");
+    trim_bang (src);
+
+    std::string expected (R"EOS(
+<ul>
+ <li> <b>hub</b> </li>
+ <li> <b>rip</b> </li>
+</ul><PRE>
+  keep   rip
+</PRE><p>a b</p><textarea>
+  x  </textarea>
+    )EOS");
+    trim_bang (expected);
+
+    mustache::layout_type layout;
+    page_type page;
+    page.bind (layout);
+    ts.ok (layout.assemble (src, true), "minify assemble");
+    std::string got;
+    layout.expand (page, got);
+    ts.ok (got == expected, "minify expand");
+}
+
+void
+test_striter_pointer (test::simple& ts)
+{
+    class page_type : public mustache::page_base {
+    public:
+        enum { TEXT };
+        char const* text;
+
+        void bind (mustache::layout_type& layout)
+        {
+            layout.bind ("text",     TEXT,     mustache::STRITER);
+        }
+
+        void valueof (int symbol, char const*& vfirst, char const*& vlast)
+        {
+            if (TEXT == symbol) {
+                vfirst = text;
+                vlast = text + std::strlen (text);
+            }
+        }
+    };
+
+    std::string src (R"EOS(
+<p>{{text}}</p>
+<p>{{{text}}}</p>
+    )EOS");
+    trim_bang (src);
+
+    std::string expected (R"EOS(
+<p>It is something to be &lt;b&gt;wrong&lt;/b&gt;, it will.</p>
+<p>It is something to be <b>wrong</b>, it will.</p>
+    )EOS");
+    trim_bang (expected);
+
+    mustache::layout_type layout;
+    std::string got;
+    page_type page;
+    page.bind (layout);
+    ts.ok (layout.assemble (src), "striter pointer assemble");
+    page.text = "It is something to be <b>wrong</b>, it will.";
+    layout.expand (page, got);
+    ts.ok (got == expected, "striter pointer expand");
+}
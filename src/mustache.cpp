@@ -1,5 +1,6 @@
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <cstdio>
 #include "mustache.hpp"
 
@@ -7,7 +8,7 @@ namespace mustache {
 
 // match XML entity: '&' ('#' ([0-9]+ | 'x' [0-9A-Fa-f]+) | [A-Za-z0-9]+) ';'
 static bool
-scan_entity (std::string::const_iterator& first, std::string::const_iterator last)
+scan_entity (char const*& first, char const* last)
 {
     static const char CODE[] =
         "@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@B@@A@@@@@@@@@FFFFFFFFFF@G@@@@"
@@ -18,7 +19,7 @@ scan_entity (std::string::const_iterator& first, std::string::const_iterator las
         0x75, 0x65, 0x77, 0x66, 0x16, 0x77, 0x17
     };
     static const std::size_t NRULE = sizeof (RULE) / sizeof (RULE[0]);
-    std::string::const_iterator p = first;
+    char const* p = first;
     int state = 2;
     for (int count = 0; count < 32 && state > 1 && p != last; ++count) {
         int const ch = static_cast<unsigned char> (*p++);
@@ -38,12 +39,19 @@ scan_entity (std::string::const_iterator& first, std::string::const_iterator las
 // if 2==escape_level then escape HTML everything
 void
 page_base::append_html (int escape_level, std::string::const_iterator first, std::string::const_iterator last, std::string& output)
+{
+    if (first < last)
+        append_html (escape_level, &*first, &*first + (last - first), output);
+}
+
+void
+page_base::append_html (int escape_level, char const* first, char const* last, std::string& output)
 {
     if (0 == escape_level) {
         output.append (first, last);
         return;
     }
-    std::string::const_iterator amp;
+    char const* amp;
     for (; first < last; ++first)
         switch (*first) {
         default: output.push_back (*first); break;
@@ -60,6 +68,22 @@ page_base::append_html (int escape_level, std::string::const_iterator first, std
         }
 }
 
+// STRITER values given by iterators unless the page hands out the
+// pointers into its own storage.
+void
+page_base::valueof (int symbol, char const*& v1, char const*& v2)
+{
+    static std::string const empty;
+    std::string::const_iterator first = empty.cbegin ();
+    std::string::const_iterator last = first;
+    valueof (symbol, first, last);
+    v1 = v2 = nullptr;
+    if (first < last) {
+        v1 = &*first;
+        v2 = v1 + (last - first);
+    }
+}
+
 void
 page_base::append_html (int escape_level, double x, std::string& output)
 {
@@ -71,13 +95,168 @@ page_base::append_html (int escape_level, double x, std::string& output)
     output += t;
 }
 
-layout_type::layout_type () : m_source (), m_program (), m_binding () {}
-layout_type::~layout_type () {}
+std::size_t
+column_block::size () const
+{
+    return symbol.empty () ? 0 : (offset.size () - 1) / symbol.size ();
+}
+
+// the symbols are small integers, which index the columns directly.
+void
+column_block::index ()
+{
+    slot.clear ();
+    for (std::size_t c = 0; c < symbol.size (); ++c) {
+        if (symbol[c] < 0)
+            continue;
+        std::size_t const sym = symbol[c];
+        if (slot.size () <= sym)
+            slot.resize (sym + 1, symbol.size ());
+        if (slot[sym] == symbol.size ())
+            slot[sym] = c;
+    }
+}
+
+std::size_t
+column_block::column (int sym) const
+{
+    return sym >= 0 && static_cast<std::size_t> (sym) < slot.size () ? slot[sym] : symbol.size ();
+}
+
+void
+column_block::clear ()
+{
+    offset.assign (1, 0);
+    buffer.clear ();
+}
 
 void
+column_block::push_back (char const* s, std::size_t n)
+{
+    buffer.append (s, n);
+    offset.push_back (buffer.size ());
+}
+
+binding_table::binding_table () : m_seed (), m_offset (), m_name (), m_value () {}
+
+// FNV-1a with a seeded offset basis and a final avalanche.
+std::uint32_t
+binding_table::hash (std::uint32_t seed, char const* s, std::size_t n)
+{
+    std::uint32_t h = 2166136261U ^ (seed * 0x9e3779b9U);
+    for (std::size_t i = 0; i < n; ++i) {
+        h ^= static_cast<unsigned char> (s[i]);
+        h *= 16777619U;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    return h;
+}
+
+// the slots start as many as the names, and are doubled each time a
+// bucket runs out of seeds.
+bool
+binding_table::build (std::map<std::string,binding_type> const& binding)
+{
+    std::size_t nslot = binding.size ();
+    for (int i = 0; i < GROW_LIMIT; ++i, nslot *= 2)
+        if (place (binding, nslot))
+            return true;
+    m_seed.clear ();
+    m_offset.assign (1, 0);
+    m_name.clear ();
+    m_value.clear ();
+    return false;
+}
+
+// place names bucket by bucket, the largest buckets first, searching
+// for each bucket a seed that drops all of its names into free slots.
+// the free slots repeat a name placed in another slot, which never
+// hashes to them, so that they match nothing.
+bool
+binding_table::place (std::map<std::string,binding_type> const& binding, std::size_t nslot)
+{
+    typedef std::map<std::string,binding_type>::const_iterator entry_type;
+    std::size_t const n = binding.size ();
+    m_seed.assign (n, 0);
+    m_offset.assign (nslot + 1, 0);
+    m_name.clear ();
+    m_value.assign (nslot, binding_type {0, 0});
+    if (0 == n)
+        return true;
+    std::vector<std::vector<entry_type>> bucket (n);
+    for (entry_type it = binding.cbegin (); it != binding.cend (); ++it)
+        bucket[hash (0, it->first.data (), it->first.size ()) % n].push_back (it);
+    std::vector<std::size_t> order (n);
+    for (std::size_t b = 0; b < n; ++b)
+        order[b] = b;
+    std::stable_sort (order.begin (), order.end (),
+        [&bucket](std::size_t a, std::size_t b) {
+            return bucket[a].size () > bucket[b].size ();
+        });
+    std::vector<bool> taken (nslot, false);
+    std::vector<entry_type> slot (nslot, binding.cbegin ());
+    std::vector<std::size_t> probe;
+    for (std::size_t const b : order) {
+        if (bucket[b].empty ())
+            break;
+        std::uint32_t seed = 1;
+        for (; seed <= SEED_LIMIT; ++seed) {
+            probe.clear ();
+            for (entry_type const it : bucket[b]) {
+                std::size_t const k = hash (seed, it->first.data (), it->first.size ()) % nslot;
+                if (taken[k] || std::find (probe.cbegin (), probe.cend (), k) != probe.cend ())
+                    break;
+                probe.push_back (k);
+            }
+            if (probe.size () == bucket[b].size ())
+                break;
+        }
+        if (seed > SEED_LIMIT)
+            return false;
+        m_seed[b] = seed;
+        for (std::size_t i = 0; i < probe.size (); ++i) {
+            taken[probe[i]] = true;
+            slot[probe[i]] = bucket[b][i];
+        }
+    }
+    for (std::size_t k = 0; k < nslot; ++k) {
+        m_offset[k] = m_name.size ();
+        m_name += slot[k]->first;
+        m_value[k] = slot[k]->second;
+    }
+    m_offset[nslot] = m_name.size ();
+    return true;
+}
+
+binding_type const*
+binding_table::find (char const* name, std::size_t len) const
+{
+    std::size_t const n = m_seed.size ();
+    if (0 == n)
+        return nullptr;
+    std::size_t const k = hash (m_seed[hash (0, name, len) % n], name, len) % m_value.size ();
+    std::size_t const first = m_offset[k];
+    if (m_offset[k + 1] - first != len || m_name.compare (first, len, name, len) != 0)
+        return nullptr;
+    return &m_value[k];
+}
+
+layout_type::layout_type ()
+    : m_source (), m_text (), m_program (), m_binding (), m_table (),
+      m_table_dirty (false), m_fragment (), m_sink (nullptr) {}
+layout_type::~layout_type () {}
+
+// a name bound twice would collide with itself under every seed of
+// the table, so that it is refused, keeping the first binding.
+bool
 layout_type::bind (std::string const& name, int symbol, int element)
 {
-    m_binding[name] = {symbol, element};
+    if (! m_binding.insert (std::make_pair (name, binding_type {symbol, element})).second)
+        return false;
+    m_table_dirty = true;
+    return true;
 }
 
 void
@@ -86,17 +265,48 @@ layout_type::expand (page_base& page, std::string& output) const
     expand_block (0, page, output);
 }
 
+// the output is handed to the sink after each element, so that the
+// whole is never kept. the CACHE sections are taken from the fragments
+// cached already, but not cached here.
+void
+layout_type::expand (page_base& page, output_sink& sink) const
+{
+    std::string output;
+    m_sink = &sink;
+    expand_block (0, page, output);
+    m_sink = nullptr;
+    if (! output.empty ())
+        sink.write (output.data (), output.size ());
+}
+
 void
 layout_type::expand_block (std::size_t ip, page_base& page, std::string& output) const
 {
-    std::string::const_iterator s = m_source.cbegin ();
+    expand_block (ip, page, nullptr, 0, output);
+}
+
+// inside a batched FOR section, the variables bound to the columns of
+// the block are taken from the cells of the current row.
+void
+layout_type::expand_block (std::size_t ip, page_base& page, column_block const* block, std::size_t row, std::string& output) const
+{
+    std::string::const_iterator s = m_text.cbegin ();
     std::size_t const limit = ip + m_program[ip].size + 1;
+    std::size_t const ncolumn = block != nullptr ? block->symbol.size () : 0;
     ++ip;
     for (; ip < limit; ++ip) {
         span_type const& op = m_program[ip];
+        std::size_t col = ncolumn;
         if ('+' == op.code) {
             output.append (s + op.first, s + op.last);
         }
+        else if (ncolumn > 0 && ('$' == op.code || '&' == op.code)
+                && (col = block->column (op.symbol)) < ncolumn) {
+            std::size_t const k = row * ncolumn + col;
+            char const* b = block->buffer.data ();
+            page_base::append_html ('$' == op.code ? 2 : 0,
+                b + block->offset[k], b + block->offset[k + 1], output);
+        }
         else if (STRING == op.element) {
             if ('$' == op.code || '&' == op.code) {
                 std::string v;
@@ -106,8 +316,8 @@ layout_type::expand_block (std::size_t ip, page_base& page, std::string& output)
         }
         else if (STRITER == op.element) {
             if ('$' == op.code || '&' == op.code) {
-                std::string::const_iterator v1 = m_source.cbegin ();
-                std::string::const_iterator v2 = v1;
+                char const* v1 = nullptr;
+                char const* v2 = nullptr;
                 page.valueof (op.symbol, v1, v2);
                 page_base::append_html ('$' == op.code ? 2 : 0, v1, v2, output);
             }
@@ -131,11 +341,21 @@ layout_type::expand_block (std::size_t ip, page_base& page, std::string& output)
                 bool v = false;
                 page.valueof (op.symbol, v);
                 if (v ^ ('^' == op.code))
-                    expand_block (ip, page, output);
+                    expand_block (ip, page, block, row, output);
             }
         }
         else if (FOR == op.element) {
-            if ('#' == op.code || '^' == op.code) {
+            column_block rows;
+            if (('#' == op.code || '^' == op.code) && page.batch (op.symbol, rows)) {
+                std::size_t const nrow = rows.size ();
+                rows.index ();
+                if ('#' == op.code)
+                    for (std::size_t r = 0; r < nrow; ++r)
+                        expand_block (ip, page, &rows, r, output);
+                else if (0 == nrow)
+                    expand_block (ip, page, output);
+            }
+            else if ('#' == op.code || '^' == op.code) {
                 page.iter (op.symbol);
                 bool v = false;
                 page.valueof (op.symbol, v);
@@ -149,22 +369,140 @@ layout_type::expand_block (std::size_t ip, page_base& page, std::string& output)
                     expand_block (ip, page, output);
             }
         }
+        else if (CACHE == op.element) {
+            // the page supplies the key; an empty key or '^' bypasses the cache.
+            if ('#' == op.code || '^' == op.code) {
+                std::string key;
+                if ('#' == op.code)
+                    page.valueof (op.symbol, key);
+                if (key.empty ()) {
+                    expand_block (ip, page, block, row, output);
+                }
+                else if (m_sink != nullptr) {
+                    // a fragment cannot be cut out of the output drained.
+                    auto const it = m_fragment.find (ip);
+                    if (it != m_fragment.end () && it->second.key == key)
+                        output.append (it->second.bytes);
+                    else
+                        expand_block (ip, page, block, row, output);
+                }
+                else {
+                    fragment_type& fragment = m_fragment[ip];
+                    if (fragment.key != key) {
+                        std::size_t const mark = output.size ();
+                        expand_block (ip, page, block, row, output);
+                        fragment.key = key;
+                        fragment.bytes.assign (output, mark, output.npos);
+                    }
+                    else {
+                        output.append (fragment.bytes);
+                    }
+                }
+            }
+        }
         else if (CUSTOM == op.element) {
             page.expand (*this, ip, op, output);
         }
         if ('#' == op.code || '^' == op.code)
             ip += op.size + 1;
+        if (m_sink != nullptr && ! output.empty ()) {
+            m_sink->write (output.data (), output.size ());
+            output.clear ();
+        }
     }
 }
 
+static inline bool
+is_space (int const c)
+{
+    return ' ' == c || '\t' == c || '\n' == c || '\r' == c || '\f' == c;
+}
+
+static inline int
+lowercase (int const c)
+{
+    return 'A' <= c && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// does the tag name at src[pos, last) equal to the lower case name?
+static bool
+tag_name_at (std::string const& src, std::size_t pos, std::size_t last, char const* name)
+{
+    for (; *name; ++name, ++pos)
+        if (pos >= last || lowercase (static_cast<unsigned char> (src[pos])) != *name)
+            return false;
+    return pos >= last || is_space (src[pos]) || '>' == src[pos] || '/' == src[pos];
+}
+
+// collapse each run of white spaces in src[first, last) into a space or
+// a newline, and drop the runs having a newline between a tag end and
+// a tag start. the contents of pre, textarea and script are left alone,
+// and preserve keeps the name of the open one across the plain spans.
+static void
+minify_plain (std::string const& src, std::size_t first, std::size_t last,
+              char const*& preserve, std::string& text)
+{
+    static char const* const PRESERVE[] = {"pre", "textarea", "script"};
+    std::size_t const mark = text.size ();
+    std::size_t i = first;
+    while (i < last) {
+        int const c = static_cast<unsigned char> (src[i]);
+        if (preserve != nullptr || ! is_space (c)) {
+            if ('<' == c && preserve != nullptr) {
+                if (i + 1 < last && '/' == src[i + 1] && tag_name_at (src, i + 2, last, preserve))
+                    preserve = nullptr;
+            }
+            else if ('<' == c) {
+                for (char const* name : PRESERVE)
+                    if (tag_name_at (src, i + 1, last, name))
+                        preserve = name;
+            }
+            text.push_back (c);
+            ++i;
+            continue;
+        }
+        bool newline = false;
+        std::size_t j = i;
+        for (; j < last && is_space (src[j]); ++j)
+            newline = newline || '\n' == src[j];
+        bool const between = text.size () > mark && '>' == text.back ()
+            && j < last && '<' == src[j];
+        if (! newline || ! between)
+            text.push_back (newline ? '\n' : ' ');
+        i = j;
+    }
+}
+
+// plain spans are copied into m_text, minified or not, and point there.
+void
+layout_type::push_plain (span_type plain, bool minify, char const*& preserve)
+{
+    std::size_t const first = m_text.size ();
+    if (minify)
+        minify_plain (m_source, plain.first, plain.last, preserve, m_text);
+    else
+        m_text.append (m_source, plain.first, plain.last - plain.first);
+    plain.first = first;
+    plain.last = m_text.size ();
+    m_program.push_back (plain);
+}
+
 bool
-layout_type::assemble (std::string const& src)
+layout_type::assemble (std::string const& src, bool minify)
 {
+    if (m_table_dirty) {
+        if (! m_table.build (m_binding))
+            return false;
+        m_table_dirty = false;
+    }
     m_source = src;
+    m_text.clear ();
     m_program.clear ();
+    m_fragment.clear ();
     m_program.push_back({'#', 0, 0, 0, 0, 0});
     span_type plain {'+', 0, 0, 0, 0, 0};
     span_type tag;
+    char const* preserve = nullptr;
     std::vector<std::size_t> section_nest;
     std::size_t dot = 0;
     std::size_t const eos = m_source.size ();
@@ -175,7 +513,7 @@ layout_type::assemble (std::string const& src)
             continue;
         if (plain.first < pos) {
             plain.last = pos;
-            m_program.push_back (plain);
+            push_plain (plain, minify, preserve);
         }
         plain.first = dot;
         if ('!' == tag.code)
@@ -197,7 +535,7 @@ layout_type::assemble (std::string const& src)
     }
     if (plain.first < dot) {
         plain.last = dot;
-        m_program.push_back (plain);
+        push_plain (plain, minify, preserve);
     }
     m_program.push_back({'/', 0, 0, 0, 0, 0});
     m_program[0].size = m_program.back ().size = m_program.size () - 2;
@@ -246,10 +584,11 @@ layout_type::match (std::size_t const pos, span_type& op) const
         }
     }
     if (1 == next_state) {
-        auto it = m_binding.find (m_source.substr (op.first, op.last - op.first));
-        if (it != m_binding.end ()) {
-            op.symbol = it->second.symbol;
-            op.element = it->second.element;
+        binding_type const* const b = m_table.find (
+            m_source.data () + op.first, op.last - op.first);
+        if (b != nullptr) {
+            op.symbol = b->symbol;
+            op.element = b->element;
         }
         if ('$' != op.code && '&' != op.code
                 && dot < m_source.size () && '\n' == m_source[dot])
@@ -6,12 +6,15 @@
  *      {{ key }}       html escape expand
  *      {{{ key }}}     raw expand
  *      {{& key }}      raw expand
- *      {{# key}}block{{/ key}}  for or if
+ *      {{# key}}block{{/ key}}  for, if or cache
  *      {{^ key}}block{{/ key}}  unless
  *      {{! comment out }}
  *
  *      key : [\w?!/.-]+
  *
+ *      assemble (str, true) collapses white spaces in the plain text
+ *      out of <pre>, <textarea> and <script>.
+ *
  *      {{> filename}}  not implemented (partial)
  *      {{=<% %>=}}     not implemented (change delimiters)
  */
@@ -19,11 +22,12 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <cstdint>
 
 namespace mustache {
 
 enum {
-    STRING = 1, STRITER, INTEGER, DOUBLE, IF, FOR, CUSTOM
+    STRING = 1, STRITER, INTEGER, DOUBLE, IF, FOR, CUSTOM, CACHE
 };
 
 class layout_type;
@@ -42,18 +46,67 @@ struct binding_type {
     int element;
 };
 
+// minimal perfect hash over the bound names (hash and displace).
+// built once from the bindings, probed with (pointer, length). the
+// seeds tried for a bucket are bounded: when a bucket finds none, the
+// table is built again with more slots, and fails after a few times.
+class binding_table {
+public:
+    binding_table ();
+    bool build (std::map<std::string,binding_type> const& binding);
+    binding_type const* find (char const* name, std::size_t len) const;
+
+private:
+    enum { SEED_LIMIT = 1 << 16, GROW_LIMIT = 4 };
+
+    static std::uint32_t hash (std::uint32_t seed, char const* s, std::size_t n);
+    bool place (std::map<std::string,binding_type> const& binding, std::size_t nslot);
+
+    std::vector<std::uint32_t> m_seed;
+    std::vector<std::size_t> m_offset;
+    std::string m_name;
+    std::vector<binding_type> m_value;
+};
+
+// a block of rows handed over at once for a FOR section.
+// the cells share one buffer and are laid out row after row, so that
+// the cell of row r, column c is buffer[offset[k], offset[k + 1])
+// with k = r * symbol.size () + c. index maps the symbols to their
+// columns once for the lookups of column.
+struct column_block {
+    std::vector<int> symbol;
+    std::vector<std::size_t> offset;
+    std::string buffer;
+    std::vector<std::size_t> slot;
+    column_block () : symbol (), offset (1, 0), buffer (), slot () {}
+    std::size_t size () const;
+    void index ();
+    std::size_t column (int sym) const;
+    void clear ();
+    void push_back (char const* s, std::size_t n);
+};
+
+// takes the expansion in pieces, instead of the string of the whole.
+struct output_sink {
+    virtual ~output_sink () {}
+    virtual void write (char const* s, std::size_t n) = 0;
+};
+
 class page_base {
 public:
     virtual ~page_base () {}
     virtual void valueof (int symbol, std::string& v) { v = ""; }
     virtual void valueof (int symbol, std::string::const_iterator& v1, std::string::const_iterator& v2) {}
+    virtual void valueof (int symbol, char const*& v1, char const*& v2);
     virtual void valueof (int symbol, long& v) { v = 0; }
     virtual void valueof (int symbol, double& v) { v = 0.0; }
     virtual void valueof (int symbol, bool& v) { v = false; }
     virtual void iter (int symbol) {}
     virtual void next (int symbol) {}
+    virtual bool batch (int symbol, column_block& block) { return false; }
     virtual void expand (layout_type const& layout, std::size_t ip, span_type const& op, std::string& output) {}
     static void append_html (int escape_level, std::string::const_iterator first, std::string::const_iterator last, std::string& output);
+    static void append_html (int escape_level, char const* first, char const* last, std::string& output);
     static void append_html (int escape_level, double x, std::string& output);
 };
 
@@ -61,18 +114,32 @@ class layout_type {
 public:
     layout_type ();
     virtual ~layout_type ();
-    void bind (std::string const& name, int symbol, int element);
-    bool assemble (std::string const& str);
+    bool bind (std::string const& name, int symbol, int element);
+    bool assemble (std::string const& str, bool minify = false);
     void expand (page_base& page, std::string& output) const;
+    void expand (page_base& page, output_sink& sink) const;
     void expand_block (std::size_t ip, page_base& page, std::string& output) const;
 
 protected:
+    void expand_block (std::size_t ip, page_base& page, column_block const* block, std::size_t row, std::string& output) const;
     std::size_t match (std::size_t const pos, span_type& op) const;
     std::size_t skip_comment (std::size_t const pos, span_type& op) const;
+    void push_plain (span_type plain, bool minify, char const*& preserve);
 
     std::string m_source;
+    std::string m_text;     // plain spans derived from m_source
     std::vector<span_type> m_program;
     std::map<std::string,binding_type> m_binding;
+    binding_table m_table;
+    bool m_table_dirty;
+
+    // rendered CACHE sections by program address, with their keys.
+    struct fragment_type {
+        std::string key;
+        std::string bytes;
+    };
+    mutable std::map<std::size_t,fragment_type> m_fragment;
+    mutable output_sink* m_sink;    // while expanding into a sink
 
 private:
     layout_type (layout_type const&);
@@ -0,0 +1,84 @@
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include "rate-limit.hpp"
+#include "taptests.hpp"
+
+// rate_limit - token buckets of the clients shared by the processes
+
+void test_burst (test::simple& ts, std::string const& dir);
+void test_refill (test::simple& ts, std::string const& dir);
+void test_shared (test::simple& ts, std::string const& dir);
+void test_slots (test::simple& ts, std::string const& dir);
+void test_unmapped (test::simple& ts, std::string const& dir);
+
+int
+main (int argc, char* argv[])
+{
+    char tmpl[] = "/tmp/rate-limit-test.XXXXXX";
+    if (::mkdtemp (tmpl) == nullptr)
+        return EXIT_FAILURE;
+    std::string const dir (tmpl);
+    test::simple ts;
+    test_burst (ts, dir);
+    test_refill (ts, dir);
+    test_shared (ts, dir);
+    test_slots (ts, dir);
+    test_unmapped (ts, dir);
+    for (char const* name : {"/burst", "/refill", "/shared", "/slots"})
+        std::remove ((dir + name).c_str ());
+    ::rmdir (dir.c_str ());
+    return ts.done_testing ();
+}
+
+void
+test_burst (test::simple& ts, std::string const& dir)
+{
+    rate_limit limit (dir + "/burst", 64, 1, 3);
+    bool const burst = limit.admit ("a") && limit.admit ("a") && limit.admit ("a");
+    ts.ok (burst, "the burst is admitted");
+    ts.ok (! limit.admit ("a"), "the request after the burst is refused");
+    ts.ok (limit.admit ("b"), "another client has a bucket of its own");
+    ts.ok (limit.admit (""), "a request without a key is admitted");
+}
+
+// 600 a minute is a token each 100 milliseconds.
+void
+test_refill (test::simple& ts, std::string const& dir)
+{
+    rate_limit limit (dir + "/refill", 64, 600, 1);
+    ts.ok (limit.admit ("a") && ! limit.admit ("a"), "the bucket is emptied");
+    ::usleep (150000);
+    ts.ok (limit.admit ("a"), "a token is refilled in time");
+    ts.ok (! limit.admit ("a"), "only one token is refilled");
+}
+
+void
+test_shared (test::simple& ts, std::string const& dir)
+{
+    rate_limit first (dir + "/shared", 64, 1, 2);
+    rate_limit second (dir + "/shared", 64, 1, 2);
+    ts.ok (first.admit ("a") && second.admit ("a"), "the burst is taken through both mappings");
+    ts.ok (! first.admit ("a") && ! second.admit ("a"), "both mappings see the empty bucket");
+}
+
+// with a single slot, the probes all land on it.
+void
+test_slots (test::simple& ts, std::string const& dir)
+{
+    rate_limit limit (dir + "/slots", 1, 600, 1);
+    ts.ok (limit.admit ("a") && ! limit.admit ("a"), "the only slot is taken");
+    ts.ok (limit.admit ("b") && limit.admit ("b"),
+        "a client without a slot left is admitted");
+    ::usleep (150000);
+    ts.ok (limit.admit ("b") && ! limit.admit ("b"),
+        "a bucket refilled to the burst gives its slot to another client");
+}
+
+void
+test_unmapped (test::simple& ts, std::string const& dir)
+{
+    rate_limit limit (dir + "/nowhere/table", 64, 1, 1);
+    ts.ok (limit.admit ("a") && limit.admit ("a"), "without a table every request is admitted");
+}
@@ -0,0 +1,117 @@
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rate-limit.hpp"
+
+static const std::uint64_t TOKEN = 1000;
+static const std::uint64_t TOKEN_MASK = (1ULL << 20) - 1;
+static const int TIME_SHIFT = 20;
+
+rate_limit::rate_limit (std::string const& path, std::size_t slots, int rate_per_minute, int burst)
+    : mslot (nullptr), mslots (slots), msize (slots * sizeof (slot_type)),
+      mrate (rate_per_minute * TOKEN),
+      mburst (std::min<std::uint64_t> (burst * TOKEN, TOKEN_MASK))
+{
+    int const fd = ::open (path.c_str (), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return;
+    struct stat st;
+    // a new file is extended with zeros, that is, with empty slots.
+    bool const ok = ::fstat (fd, &st) == 0
+        && (static_cast<std::size_t> (st.st_size) == msize
+            || (0 == st.st_size && ::ftruncate (fd, msize) == 0));
+    if (ok) {
+        void* p = ::mmap (nullptr, msize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED != p)
+            mslot = static_cast<slot_type*> (p);
+    }
+    ::close (fd);
+}
+
+rate_limit::~rate_limit ()
+{
+    if (mslot != nullptr)
+        ::munmap (mslot, msize);
+}
+
+bool
+rate_limit::admit (std::string const& key)
+{
+    if (mslot == nullptr || 0 == mslots || key.empty ())
+        return true;
+    std::uint64_t const h = hash (key);
+    std::uint64_t const now = now_msec ();
+    std::size_t const home = h % mslots;
+    for (int i = 0; i < PROBE; ++i) {
+        slot_type* const slot = &mslot[(home + i) % mslots];
+        std::uint64_t k = __atomic_load_n (&slot->key, __ATOMIC_ACQUIRE);
+        if (h == k)
+            return take (slot, now);
+        // an empty slot or a full bucket of another client is taken over.
+        std::uint64_t const state = __atomic_load_n (&slot->state, __ATOMIC_ACQUIRE);
+        if (0 != k && refill (state, now) < mburst)
+            continue;
+        if (__atomic_compare_exchange_n (&slot->key, &k, h, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return take (slot, now);
+        if (h == k)
+            return take (slot, now);
+    }
+    return true;
+}
+
+// the tokens of the state after the time elapsed till now.
+std::uint64_t
+rate_limit::refill (std::uint64_t state, std::uint64_t now) const
+{
+    std::uint64_t const then = state >> TIME_SHIFT;
+    std::uint64_t tokens = state & TOKEN_MASK;
+    // a zero state is an empty slot, as full as a new bucket.
+    if (0 == state || now < then)
+        return mburst;
+    std::uint64_t const elapsed = now - then;
+    if (elapsed >= 60000 * (mburst / (mrate > 0 ? mrate : 1) + 1))
+        return mburst;
+    tokens += elapsed * mrate / 60000;
+    return tokens < mburst ? tokens : mburst;
+}
+
+bool
+rate_limit::take (slot_type* slot, std::uint64_t now)
+{
+    std::uint64_t state = __atomic_load_n (&slot->state, __ATOMIC_ACQUIRE);
+    for (;;) {
+        std::uint64_t const tokens = refill (state, now);
+        if (tokens < TOKEN)
+            return false;
+        std::uint64_t const next = (now << TIME_SHIFT) | (tokens - TOKEN);
+        if (__atomic_compare_exchange_n (&slot->state, &state, next, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return true;
+    }
+}
+
+// FNV-1a, never zero, as zero marks an empty slot.
+std::uint64_t
+rate_limit::hash (std::string const& key)
+{
+    std::uint64_t h = 14695981039346656037ULL;
+    for (char const c : key) {
+        h ^= static_cast<unsigned char> (c);
+        h *= 1099511628211ULL;
+    }
+    return 0 == h ? 1 : h;
+}
+
+std::uint64_t
+rate_limit::now_msec ()
+{
+    struct timespec ts;
+    ::clock_gettime (CLOCK_MONOTONIC, &ts);
+    return static_cast<std::uint64_t> (ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
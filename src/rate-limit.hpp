@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+/* token buckets of the clients shared by the processes
+ *
+ *      rate_limit limit ("/dev/shm/suzume-ratelimit", 4096, 12, 10);
+ *      if (! limit.admit (req.env["REMOTE_ADDR"]))
+ *          return res.too_many_requests ();
+ *
+ * each client has a bucket of burst tokens refilled by rate_per_minute,
+ * and a request takes a token out of it. the buckets are kept in a hash
+ * table of a fixed number of slots in a file mapped shared, and updated
+ * with compare and swap, so that the processes need no lock. a bucket
+ * refilled up to the burst is the same as none, so that its slot may be
+ * taken by another client. when no slot is left for a client, or the
+ * table cannot be mapped, the request is admitted.
+ */
+
+class rate_limit {
+public:
+    rate_limit (std::string const& path, std::size_t slots, int rate_per_minute, int burst);
+    ~rate_limit ();
+    bool admit (std::string const& key);
+
+private:
+    enum { PROBE = 8 };
+
+    // state: milliseconds in the upper 44 bits, milli-tokens in the lower 20.
+    struct slot_type {
+        std::uint64_t key;
+        std::uint64_t state;
+    };
+
+    static std::uint64_t hash (std::string const& key);
+    static std::uint64_t now_msec ();
+    std::uint64_t refill (std::uint64_t state, std::uint64_t now) const;
+    bool take (slot_type* slot, std::uint64_t now);
+
+    slot_type* mslot;
+    std::size_t mslots;
+    std::size_t msize;
+    std::uint64_t const mrate;      // milli-tokens per minute
+    std::uint64_t const mburst;     // milli-tokens
+
+    rate_limit (rate_limit const&);
+    rate_limit& operator= (rate_limit const&);
+};
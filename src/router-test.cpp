@@ -0,0 +1,181 @@
+#include <string>
+#include "router.hpp"
+#include "taptests.hpp"
+
+// router - the routes from the method and PATH_INFO to the handlers
+
+struct appl_type {
+    std::string called;
+    http::strings_type param;
+
+    bool get_index (http::request& req, http::response& res, http::strings_type const& p)
+    {
+        return call ("get_index", p);
+    }
+
+    bool get_entry (http::request& req, http::response& res, http::strings_type const& p)
+    {
+        return call ("get_entry", p);
+    }
+
+    bool get_new (http::request& req, http::response& res, http::strings_type const& p)
+    {
+        return call ("get_new", p);
+    }
+
+    bool post_entry (http::request& req, http::response& res, http::strings_type const& p)
+    {
+        return call ("post_entry", p);
+    }
+
+    bool head_feed (http::request& req, http::response& res, http::strings_type const& p)
+    {
+        return call ("head_feed", p);
+    }
+
+    bool get_feed (http::request& req, http::response& res, http::strings_type const& p)
+    {
+        return call ("get_feed", p);
+    }
+
+    bool get_comment (http::request& req, http::response& res, http::strings_type const& p)
+    {
+        return call ("get_comment", p);
+    }
+
+    bool call (std::string const& name, http::strings_type const& p)
+    {
+        called = name;
+        param.assign (p.begin (), p.end ());
+        return true;
+    }
+};
+
+void test_static_and_capture (test::simple& ts);
+void test_empty_segments (test::simple& ts);
+void test_not_found (test::simple& ts);
+void test_method_not_allowed (test::simple& ts);
+void test_head (test::simple& ts);
+
+int
+main (int argc, char* argv[])
+{
+    test::simple ts;
+    test_static_and_capture (ts);
+    test_empty_segments (ts);
+    test_not_found (ts);
+    test_method_not_allowed (ts);
+    test_head (ts);
+    return ts.done_testing ();
+}
+
+static http::router<appl_type> const&
+routes ()
+{
+    static http::router<appl_type> r;
+    static bool done = false;
+    if (! done) {
+        r.add ("GET", "/", &appl_type::get_index);
+        r.add ("GET", "/entries/:id", &appl_type::get_entry);
+        r.add ("POST", "/entries/:id", &appl_type::post_entry);
+        r.add ("GET", "/entries/new", &appl_type::get_new);
+        r.add ("GET", "/entries/:id/comments/:n", &appl_type::get_comment);
+        r.add ("HEAD", "/feed", &appl_type::head_feed);
+        r.add ("GET", "/feed", &appl_type::get_feed);
+        done = true;
+    }
+    return r;
+}
+
+// the handler called, or the status when none is.
+static std::string
+dispatch (std::string const& method, std::string const& path,
+          appl_type& app, http::response& res)
+{
+    http::request req;
+    req.method = method;
+    req.env["PATH_INFO"] = path;
+    routes ().dispatch (app, req, res);
+    return app.called.empty () ? res.status.substr (0, 3) : app.called;
+}
+
+static std::string
+dispatch (std::string const& method, std::string const& path)
+{
+    appl_type app;
+    http::response res;
+    return dispatch (method, path, app, res);
+}
+
+// the header of the name, or "" when there is none.
+static std::string
+header (http::response const& res, std::string const& name)
+{
+    for (std::size_t i = 0; i + 1 < res.headers.size (); i += 2)
+        if (res.headers[i] == name)
+            return res.headers[i + 1];
+    return "";
+}
+
+void
+test_static_and_capture (test::simple& ts)
+{
+    ts.ok (dispatch ("GET", "/") == "get_index", "root");
+    ts.ok (dispatch ("GET", "/entries/new") == "get_new",
+        "static segment added after a capture is preferred");
+    appl_type app;
+    http::response res;
+    ts.ok (dispatch ("GET", "/entries/42", app, res) == "get_entry"
+        && app.param.size () == 1 && app.param[0] == "42", "capture");
+    appl_type app2;
+    ts.ok (dispatch ("GET", "/entries/7/comments/3", app2, res) == "get_comment"
+        && app2.param.size () == 2 && app2.param[0] == "7" && app2.param[1] == "3",
+        "captures in order");
+    ts.ok (dispatch ("GET", "/entries/new/comments/3") == "404",
+        "no backtracking from a static segment into a capture");
+}
+
+void
+test_empty_segments (test::simple& ts)
+{
+    ts.ok (dispatch ("GET", "") == "get_index", "empty path is the root");
+    ts.ok (dispatch ("GET", "//") == "get_index", "slashes only are the root");
+    ts.ok (dispatch ("GET", "//entries///new/") == "get_new", "empty segments are ignored");
+    appl_type app;
+    http::response res;
+    ts.ok (dispatch ("GET", "/entries//42", app, res) == "get_entry"
+        && app.param.size () == 1 && app.param[0] == "42",
+        "an empty segment is not captured");
+}
+
+void
+test_not_found (test::simple& ts)
+{
+    ts.ok (dispatch ("GET", "/nowhere") == "404", "unknown segment");
+    ts.ok (dispatch ("GET", "/entries") == "404", "inner node without handlers");
+    ts.ok (dispatch ("GET", "/entries/42/comments") == "404", "path cut short");
+    ts.ok (dispatch ("GET", "/feed/more") == "404", "path too long");
+}
+
+void
+test_method_not_allowed (test::simple& ts)
+{
+    appl_type app;
+    http::response res;
+    ts.ok (dispatch ("DELETE", "/entries/42", app, res) == "405", "405 on a known path");
+    ts.ok (header (res, "Allow") == "GET, POST, HEAD", "Allow lists the methods and HEAD");
+    appl_type app2;
+    http::response res2;
+    ts.ok (dispatch ("POST", "/feed", app2, res2) == "405"
+        && header (res2, "Allow") == "HEAD, GET", "HEAD of its own is not listed twice");
+    ts.ok (dispatch ("get", "/") == "405", "the method is case sensitive");
+}
+
+void
+test_head (test::simple& ts)
+{
+    ts.ok (dispatch ("HEAD", "/") == "get_index", "HEAD falls back to GET");
+    ts.ok (dispatch ("HEAD", "/entries/42") == "get_entry", "HEAD falls back to GET with a capture");
+    ts.ok (dispatch ("HEAD", "/feed") == "head_feed", "HEAD of its own is preferred");
+    ts.ok (dispatch ("GET", "/feed") == "get_feed", "GET beside HEAD");
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "http.hpp"
+
+namespace http {
+
+/* trie of the routes from the method and PATH_INFO to the handlers
+ *
+ *      http::router<appl_type> routes;
+ *      routes.add ("GET", "/", &appl_type::get_index);
+ *      routes.add ("GET", "/entries/:id", &appl_type::get_entry);
+ *      ...
+ *      return routes.dispatch (*this, req, res);   // in appl_type::call
+ *
+ * the path is split into segments at slashes, and the empty segments
+ * are ignored. a segment of a pattern starting with a colon captures
+ * any segment into the strings given to the handler, in order. a
+ * static segment is preferred to a capture without backtracking. the
+ * dispatch walks a node per segment, looking up its children by binary
+ * search, so that its cost is independent of the number of the routes.
+ * HEAD is given to the handler of GET unless it has got its own. a path
+ * without a route gets 404, and a method without a handler on the path
+ * gets 405.
+ */
+
+template<typename T>
+class router {
+public:
+    typedef bool (T::*handler_type) (request& req, response& res, strings_type const& param);
+
+    router () : mnode (1) {}
+
+    void add (std::string const& method, std::string const& pattern, handler_type handler)
+    {
+        std::size_t n = 0;
+        std::size_t first, last;
+        for (std::size_t pos = 0; next_segment (pattern.data (), pattern.size (), pos, first, last); ) {
+            std::string const segment = pattern.substr (first, last - first);
+            if (segment[0] == ':') {
+                if (mnode[n].capture == 0) {
+                    mnode[n].capture = mnode.size ();
+                    mnode.push_back (node_type ());
+                }
+                n = mnode[n].capture;
+                continue;
+            }
+            auto& child = mnode[n].child;
+            auto it = std::lower_bound (child.begin (), child.end (), segment,
+                [](edge_type const& e, std::string const& s) { return e.first < s; });
+            if (it != child.end () && it->first == segment) {
+                n = it->second;
+                continue;
+            }
+            child.insert (it, edge_type (segment, mnode.size ()));
+            n = mnode.size ();
+            mnode.push_back (node_type ());
+        }
+        mnode[n].handler.push_back (std::make_pair (method, handler));
+    }
+
+    bool dispatch (T& app, request& req, response& res) const
+    {
+        auto const it = req.env.find ("PATH_INFO");
+        char const* const path = it == req.env.end () ? "" : it->second.data ();
+        std::size_t const size = it == req.env.end () ? 0 : it->second.size ();
+        strings_type param (strings_type::allocator_type (req.memory));
+        std::size_t n = 0;
+        std::size_t first, last;
+        for (std::size_t pos = 0; next_segment (path, size, pos, first, last); ) {
+            std::size_t const i = find_child (mnode[n], path + first, last - first);
+            if (i == 0 && mnode[n].capture == 0)
+                return res.not_found ();
+            if (i == 0)
+                param.push_back (std::string (path + first, last - first));
+            n = i != 0 ? i : mnode[n].capture;
+        }
+        std::string allow;
+        handler_type get = nullptr;
+        bool head = false;
+        for (auto const& h : mnode[n].handler) {
+            if (h.first == req.method)
+                return (app.*(h.second)) (req, res, param);
+            if (h.first == "GET")
+                get = h.second;
+            head = head || h.first == "HEAD";
+            allow += (allow.empty () ? "" : ", ") + h.first;
+        }
+        if (get != nullptr && req.method == "HEAD")
+            return (app.*get) (req, res, param);
+        if (get != nullptr && ! head)
+            allow += ", HEAD";
+        if (allow.empty ())
+            return res.not_found ();
+        return res.method_not_allowed (allow);
+    }
+
+private:
+    typedef std::pair<std::string, std::size_t> edge_type;
+
+    // the root is the node 0, which is never a child.
+    struct node_type {
+        std::vector<edge_type> child;   // sorted by the segment
+        std::size_t capture;
+        std::vector<std::pair<std::string, handler_type>> handler;
+        node_type () : child (), capture (0), handler () {}
+    };
+
+    std::vector<node_type> mnode;
+
+    // [first, last) of the next non-empty segment from pos.
+    static bool next_segment (char const* path, std::size_t size, std::size_t& pos,
+                              std::size_t& first, std::size_t& last)
+    {
+        while (pos < size && path[pos] == '/')
+            ++pos;
+        first = pos;
+        while (pos < size && path[pos] != '/')
+            ++pos;
+        last = pos;
+        return first < last;
+    }
+
+    static std::size_t find_child (node_type const& node, char const* s, std::size_t n)
+    {
+        std::size_t lo = 0;
+        std::size_t hi = node.child.size ();
+        while (lo < hi) {
+            std::size_t const mid = lo + (hi - lo) / 2;
+            int const c = node.child[mid].first.compare (0, std::string::npos, s, n);
+            if (c == 0)
+                return node.child[mid].second;
+            if (c < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return 0;
+    }
+};
+
+}//namespace http
@@ -2,28 +2,60 @@
 #include <unistd.h>
 #include <cstdio>
 #include <cstring>
+#include <cstdint>
 #include "http.hpp"
 #include "runcgi.hpp"
 
 static void req_from_environment (http::request& req);
 static void req_patch_path_info (http::request& req);
-static void res_write_stdout (http::response& res);
+static void res_encode (http::request& req, http::response& res);
+static std::size_t res_write_stdout (http::request& req, http::response& res);
+static void res_record (metrics& stats, http::request& req, http::response& res,
+                        std::size_t bytes_out, std::uint64_t usec);
+static void res_log (access_log& log, metrics* stats, http::request& req, http::response& res,
+                     std::size_t bytes_out, std::uint64_t usec, std::uint64_t call_usec);
+static std::uint64_t req_content_length (http::request& req);
 static char const* canonical_status_code (std::string const& code);
 
+// the nodes of the containers of the request and the response are
+// allocated in the arena, which goes with them at the return.
 void
-runcgi (http::appl& app)
+runcgi (http::appl& app, metrics* stats, access_log* log)
 {
-    http::request req;
-    http::response res;
-    req.input = fdopen (dup (fileno (stdin)), "rb");
-    req_from_environment (req);
-    req_patch_path_info (req);
-    if (req.content_length.status == "400 Bad Request")
-        res.bad_request ();
-    else if (! app.call (req, res))
-        res.internal_server_error ();
-    fclose (req.input);
-    res_write_stdout (res);
+    std::uint64_t const start = metrics::now_usec ();
+    std::uint64_t call_usec = 0;
+    if (stats != nullptr)
+        stats->begin ();
+    arena memory;
+    {
+        http::request req (&memory);
+        http::response res (&memory);
+        req.input = fdopen (dup (fileno (stdin)), "rb");
+        req_from_environment (req);
+        req_patch_path_info (req);
+        if (req.content_length.status == "400 Bad Request")
+            res.bad_request ();
+        else if (! app.admit (req))
+            res.too_many_requests ();
+        else {
+            std::uint64_t const call_start = metrics::now_usec ();
+            if (! app.call (req, res))
+                res.internal_server_error ();
+            call_usec = metrics::now_usec () - call_start;
+            if (stats != nullptr)
+                stats->latency (metrics::CALL, call_usec);
+        }
+        fclose (req.input);
+        res_encode (req, res);
+        std::size_t const bytes_out = res_write_stdout (req, res);
+        std::uint64_t const usec = metrics::now_usec () - start;
+        if (stats != nullptr)
+            res_record (*stats, req, res, bytes_out, usec);
+        if (log != nullptr) {
+            res_log (*log, stats, req, res, bytes_out, usec, call_usec);
+            log->flush ();
+        }
+    }
 }
 
 static void
@@ -36,7 +68,7 @@ req_from_environment (http::request& req)
         std::string k = std::string(*p, eq - *p);
         std::string v = std::string (eq + 1);
         if (k == "REQUEST_METHOD")
-            req.method = v == "POST" ? v : "GET";
+            req.method = v;
         else if (k == "CONTENT_TYPE")
             req.content_type = v;
         else if (k == "CONTENT_LENGTH")
@@ -51,13 +83,38 @@ req_patch_path_info (http::request& req)
     if (req.env.count ("PATH_INFO") == 0)
         req.env["PATH_INFO"] = "";
     if (req.env.at ("SCRIPT_NAME") == "/") {
-        req.env["PATH_INFO"] = req.env["SCRIPT_NAME"] + req.env["PATCH_INFO"];
+        req.env["PATH_INFO"] = req.env["SCRIPT_NAME"] + req.env["PATH_INFO"];
         req.env["SCRIPT_NAME"] = "";
     }
 }
 
+// the text bodies are compressed when the client accepts, unless the
+// application has encoded the body already.
 static void
-res_write_stdout (http::response& res)
+res_encode (http::request& req, http::response& res)
+{
+    bool const ok = res.status.compare (0, 3, "200") == 0;
+    bool const not_modified = res.status.compare (0, 3, "304") == 0;
+    bool const text = res.content_type.compare (0, 5, "text/") == 0
+        || res.content_type.find ("json") != res.content_type.npos;
+    if (! (ok || not_modified) || ! text)
+        return;
+    res.headers.push_back ("Vary");
+    res.headers.push_back ("Accept-Encoding");
+    if (! ok || ! res.content_encoding.empty () || res.head_only)
+        return;
+    std::string const coding = http::accept_encoding (req.env);
+    std::string encoded;
+    if (! coding.empty () && http::content_encode (coding, res.body, encoded)) {
+        res.body.swap (encoded);
+        res.content_encoding = coding;
+    }
+}
+
+// the response to HEAD has the header fields of GET without the body.
+// it returns the size of the body written.
+static std::size_t
+res_write_stdout (http::request& req, http::response& res)
 {
     char const* const canon_status = canonical_status_code (res.status);
     if (canon_status != nullptr)
@@ -65,26 +122,78 @@ res_write_stdout (http::response& res)
     FILE* out = fdopen (dup (fileno (stdout)), "wb");
     if (res.status != "200 OK")
         std::fprintf (out, "Status: %s\x0d\x0a", res.status.c_str ());
+    bool const has_body = res.status != "303 See Other" && res.status != "304 Not Modified";
     if (res.status == "303 See Other") {
         std::fprintf (out, "Location: %s\x0d\x0a", res.location.c_str ());
     }
-    else {
+    else if (has_body) {
         std::fprintf (out, "Content-Type: %s\x0d\x0a", res.content_type.c_str ());
-        std::fprintf (out, "Content-Length: %zu\x0d\x0a", res.body.size ());
+        std::fprintf (out, "Content-Length: %zu\x0d\x0a",
+            res.head_only ? res.measured : res.body.size ());
+        if (! res.content_encoding.empty ())
+            std::fprintf (out, "Content-Encoding: %s\x0d\x0a", res.content_encoding.c_str ());
     }
     for (std::size_t i = 0; i < res.headers.size (); i += 2)
         std::fprintf (out, "%s: %s\x0d\x0a",
             res.headers[i].c_str (), res.headers[i + 1].c_str ());
     std::fprintf (out, "\x0d\x0a");
-    if (res.status != "303 See Other")
-        std::fwrite (&res.body[0], sizeof (res.body[0]), res.body.size(), out);
+    std::size_t size = 0;
+    if (has_body && req.method != "HEAD")
+        size = std::fwrite (&res.body[0], sizeof (res.body[0]), res.body.size(), out);
     fclose (out);
+    return size;
+}
+
+static void
+res_record (metrics& stats, http::request& req, http::response& res,
+            std::size_t bytes_out, std::uint64_t usec)
+{
+    stats.request (req.method, std::atoi (res.status.c_str ()),
+        req_content_length (req), bytes_out);
+    stats.latency (metrics::TOTAL, usec);
+}
+
+// the phases inside the application are taken from the metrics.
+static void
+res_log (access_log& log, metrics* stats, http::request& req, http::response& res,
+         std::size_t bytes_out, std::uint64_t usec, std::uint64_t call_usec)
+{
+    auto const uri = req.env.find ("REQUEST_URI");
+    std::string path;
+    if (uri != req.env.end ())
+        path = uri->second;
+    else {
+        auto const script = req.env.find ("SCRIPT_NAME");
+        auto const info = req.env.find ("PATH_INFO");
+        if (script != req.env.end ())
+            path = script->second;
+        if (info != req.env.end ())
+            path += info->second;
+    }
+    access_log::record r;
+    access_log::fill (r, req.method, path, std::atoi (res.status.c_str ()),
+        req_content_length (req), bytes_out);
+    r.usec[access_log::TOTAL] = static_cast<std::uint32_t> (usec);
+    r.usec[access_log::CALL] = static_cast<std::uint32_t> (call_usec);
+    if (stats != nullptr) {
+        r.usec[access_log::RENDER] = static_cast<std::uint32_t> (stats->last (metrics::RENDER));
+        r.usec[access_log::COMMIT] = static_cast<std::uint32_t> (stats->last (metrics::COMMIT));
+    }
+    log.push (r);
+}
+
+static std::uint64_t
+req_content_length (http::request& req)
+{
+    if (req.content_length.status != "200 OK")
+        return 0;
+    return std::strtoull (req.content_length.string.c_str (), nullptr, 10);
 }
 
 static char const*
 canonical_status_code (std::string const& code)
 {
-    // RFC 7231 HTTP/1.1: Semantics and Content
+    // RFC 7231 HTTP/1.1: Semantics and Content, 304 of RFC 7232, 429 of RFC 6585
     static const char* STATUS_CODE[] = {
         "100 Continue",                         // 00
         "101 Switching Protocols",              // 01
@@ -98,46 +207,49 @@ canonical_status_code (std::string const& code)
         "301 Moved Permanently",                // 09
         "302 Found",                            // 0a
         "303 See Other",                        // 0b
-        "305 Use Proxy",                        // 0c
-        "307 Temporary Redirect",               // 0d
-        "400 Bad Request",                      // 0e
-        "402 Payment Required",                 // 0f
-        "403 Forbidden",                        // 10
-        "404 Not Found",                        // 11
-        "405 Method Not Allowed",               // 12
-        "406 Not Acceptable",                   // 13
-        "408 Request Timeout",                  // 14
-        "409 Conflict",                         // 15
-        "410 Gone",                             // 16
-        "411 Length Required",                  // 17
-        "413 Payload Too Large",                // 18
-        "414 URI Too Long",                     // 19
-        "415 Unsupported Media Type",           // 1a
-        "417 Expectation Failed",               // 1b
-        "426 Upgrade Required",                 // 1c
-        "500 Internal Server Error",            // 1d
-        "501 Not Implemented",                  // 1e
-        "502 Bad Gateway",                      // 1f
-        "503 Service Unavailable",              // 20
-        "504 Gateway Timeout",                  // 21
-        "505 HTTP Version Not Supported"        // 22
+        "304 Not Modified",                     // 0c
+        "305 Use Proxy",                        // 0d
+        "307 Temporary Redirect",               // 0e
+        "400 Bad Request",                      // 0f
+        "402 Payment Required",                 // 10
+        "403 Forbidden",                        // 11
+        "404 Not Found",                        // 12
+        "405 Method Not Allowed",               // 13
+        "406 Not Acceptable",                   // 14
+        "408 Request Timeout",                  // 15
+        "409 Conflict",                         // 16
+        "410 Gone",                             // 17
+        "411 Length Required",                  // 18
+        "413 Payload Too Large",                // 19
+        "414 URI Too Long",                     // 1a
+        "415 Unsupported Media Type",           // 1b
+        "417 Expectation Failed",               // 1c
+        "426 Upgrade Required",                 // 1d
+        "429 Too Many Requests",                // 1e
+        "500 Internal Server Error",            // 1f
+        "501 Not Implemented",                  // 20
+        "502 Bad Gateway",                      // 21
+        "503 Service Unavailable",              // 22
+        "504 Gateway Timeout",                  // 23
+        "505 HTTP Version Not Supported"        // 24
     };
     static char BASE[] = {
-        -1, 20, 22, 25, 5, 31, 8, 10, 16, 24, 34, 30, 42
+        -1, 5, 6, 8, 9, 15, 16, 24, 27, 37, 37, 22, 47
     };
     static unsigned short RULE[] = {
-        0x1d21, 0x1d31, 0x1d41, 0x1d51, 0x1d61, 0x1da5, 0x1db5, 0x1dc5,
-        0x0007, 0x0107, 0x0208, 0x0308, 0x0408, 0x0508, 0x0608, 0x0708,
-        0x0809, 0x0909, 0x0a09, 0x0b09, 0x1d72, 0x0c09, 0x1d83, 0x0d09,
-        0x0e0a, 0x1d94, 0x0f0a, 0x100a, 0x110a, 0x120a, 0x130a, 0x1dd6,
-        0x140a, 0x150a, 0x160b, 0x170b, 0x1c0c, 0x180b, 0x190b, 0x1a0b,
-        0x1d00, 0x1b0b, 0x1d0d, 0x1e0d, 0x1f0d, 0x200d, 0x210d, 0x220d
+        0x1f21, 0x1f41, 0x1f61, 0x1f81, 0x1fc1, 0x1f32, 0x0003, 0x0103,
+        0x1f54, 0x0205, 0x0305, 0x0405, 0x0505, 0x0605, 0x0705, 0x1f76,
+        0x0807, 0x0907, 0x0a07, 0x0b07, 0x0c07, 0x0d07, 0x1fdc, 0x0e07,
+        0x1f98, 0x1fa8, 0x1fb8, 0x0f09, 0x1f00, 0x1009, 0x1109, 0x1209,
+        0x1309, 0x1409, 0x1f00, 0x1509, 0x1609, 0x170a, 0x180a, 0x1f00,
+        0x190a, 0x1a0a, 0x1b0a, 0x1d0b, 0x1c0a, 0x1f00, 0x1e0b, 0x1f0d,
+        0x200d, 0x210d, 0x220d, 0x230d, 0x240d
     };
     static const std::size_t NRULE = sizeof (RULE) / sizeof (RULE[0]);
     if (code.size () < 3 || (code.size () > 3 && code[3] != ' '))
         return nullptr;
     unsigned int status = 1;
-    int entry = 0x1d;
+    int entry = 0x1f;
     for (std::size_t i = 0; i < 3; ++i) {
         int const ch = static_cast<unsigned char> (code[i]);
         if (ch < '0' || '9' < ch)
@@ -2,7 +2,11 @@
 #define RUNCGI_H
 
 #include "http.hpp"
+#include "metrics.hpp"
+#include "access-log.hpp"
 
-void runcgi (http::appl& app);
+// stats, if given, counts the request with its status and latencies,
+// and log, if given, gets a record of it.
+void runcgi (http::appl& app, metrics* stats = nullptr, access_log* log = nullptr);
 
 #endif
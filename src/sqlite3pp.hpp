@@ -3,28 +3,78 @@
 #include <string>
 #include <memory>
 #include <utility>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
 #include <sqlite3.h>
 
 namespace sqlite3pp {
 
+// connection settings applied at opening, each kept default when
+// empty or zero, or negative for mmap_size.
+struct options {
+    std::string journal_mode;   // "WAL", "DELETE", ...
+    std::string synchronous;    // "OFF", "NORMAL", "FULL", ...
+    int busy_timeout;           // milliseconds to wait for a lock
+    int cache_size;             // pages, or KiB when negative as the pragma
+    sqlite3_int64 mmap_size;    // bytes
+    bool readonly;              // opened read-only and query_only
+    options ()
+        : journal_mode (), synchronous (), busy_timeout (0),
+          cache_size (0), mmap_size (-1), readonly (false) {}
+};
+
+// how often and how long a connection waited on the locks.
+struct lock_stats {
+    unsigned long busy;         // locks found busy
+    unsigned long timeout;      // waits given up
+    unsigned long long wait_usec;
+    lock_stats () : busy (0), timeout (0), wait_usec (0) {}
+};
+
 class statement {
 private:
     std::shared_ptr<struct sqlite3_stmt> mstmt;
 public:
+    statement () : mstmt () { }
     statement (sqlite3_stmt* pstmt) : mstmt (pstmt, sqlite3_finalize) { }
+    bool prepared () const { return mstmt != nullptr; }
     int reset () { return sqlite3_reset (mstmt.get ()); }
+    int clear_bindings () { return sqlite3_clear_bindings (mstmt.get ()); }
     int bind (int n, int v) { return sqlite3_bind_int (mstmt.get (), n, v); }
     int bind (int n, double v) { return sqlite3_bind_double (mstmt.get (), n, v); }
+    int bind (int n, sqlite3_int64 v) { return sqlite3_bind_int64 (mstmt.get (), n, v); }
     int step () { return sqlite3_step (mstmt.get ()); }
     int column_int (int n) { return sqlite3_column_int (mstmt.get (), n); }
+    sqlite3_int64 column_int64 (int n) { return sqlite3_column_int64 (mstmt.get (), n); }
     double column_double (int n) { return sqlite3_column_double (mstmt.get (), n); }
+    char const* column_text (int n) { return (char const*)sqlite3_column_text (mstmt.get (), n); }
+    int column_bytes (int n) { return sqlite3_column_bytes (mstmt.get (), n); }
+    int column_type (int n) { return sqlite3_column_type (mstmt.get (), n); }
 
-    int bind (int n, std::string s)
+    int bind (int n, std::string const& s)
     {
         return sqlite3_bind_text (
             mstmt.get (), n, s.c_str (), (int)s.size (), SQLITE_TRANSIENT);
     }
 
+    // bound without copying: the caller keeps the bytes until the
+    // statement is reset and unbound.
+    int bind_static (int n, char const* s, std::size_t size)
+    {
+        return sqlite3_bind_text (mstmt.get (), n, s, (int)size, SQLITE_STATIC);
+    }
+
+    // the text in the row without copying, valid until the next step
+    // or reset of the statement.
+    char const* column_text (int n, std::size_t& size)
+    {
+        char const* s = (char const*)sqlite3_column_text (mstmt.get (), n);
+        size = sqlite3_column_bytes (mstmt.get (), n);
+        return s;
+    }
+
     std::string column_string (int n)
     {
         std::string s ((char const*)sqlite3_column_text (mstmt.get (), n),
@@ -41,16 +91,54 @@ public:
 
 class connection {
 private:
+    struct busy_state {
+        int timeout;
+        lock_stats stats;
+    };
+    // registered to the handle, so that declared before mdb.
+    std::shared_ptr<busy_state> mbusy;
     std::shared_ptr<struct sqlite3> mdb;
+    // prepared statements by SQL text, shared among the copies.
+    // declared after mdb to be finalized before closing.
+    std::shared_ptr<std::map<std::string,statement>> mcache;
     int mstatus;
 public:
     connection (std::string s)
+        : connection (s, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) {}
+
+    // a read-only connection leaves the journal mode and the synchronous
+    // to the writers, and refuses to modify the database.
+    connection (std::string s, options const& opt)
+        : connection (s, opt.readonly ? SQLITE_OPEN_READONLY
+                                      : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)
+    {
+        if (SQLITE_OK != mstatus)
+            return;
+        if (opt.busy_timeout > 0) {
+            mbusy->timeout = opt.busy_timeout;
+            sqlite3_busy_handler (mdb.get (), busy_handler, mbusy.get ());
+        }
+        if (opt.readonly)
+            pragma ("query_only", "1");
+        if (! opt.readonly && ! opt.journal_mode.empty ())
+            pragma ("journal_mode", opt.journal_mode);
+        if (! opt.readonly && ! opt.synchronous.empty ())
+            pragma ("synchronous", opt.synchronous);
+        if (opt.cache_size != 0)
+            pragma ("cache_size", std::to_string (opt.cache_size));
+        if (opt.mmap_size >= 0)
+            pragma ("mmap_size", std::to_string (opt.mmap_size));
+        if (SQLITE_ROW == mstatus || SQLITE_DONE == mstatus)
+            mstatus = SQLITE_OK;
+    }
+
+    int pragma (std::string const& name, std::string const& value)
     {
-        sqlite3* pdb;
-        mstatus = sqlite3_open (s.c_str (), &pdb);
-        mdb = std::shared_ptr<struct sqlite3>(pdb, sqlite3_close);
+        return execute ("PRAGMA " + name + " = " + value + ";");
     }
 
+    lock_stats const& stats () const { return mbusy->stats; }
+
     statement prepare (std::string s)
     {
         sqlite3_stmt* stmt;
@@ -58,6 +146,23 @@ public:
         return statement (stmt);
     }
 
+    // prepare once and hand out the same statement reset and unbound
+    // later. a cached statement serves one user at a time.
+    statement cache (std::string const& s)
+    {
+        auto it = mcache->find (s);
+        if (it != mcache->end ()) {
+            it->second.reset ();
+            it->second.clear_bindings ();
+            mstatus = SQLITE_OK;
+            return it->second;
+        }
+        statement sth = prepare (s);
+        if (SQLITE_OK == mstatus)
+            mcache->emplace (s, sth);
+        return sth;
+    }
+
     int status () { return mstatus; }
     std::string errmsg () { return std::string (sqlite3_errmsg (mdb.get ())); }
     sqlite3_int64 last_insert_rowid () { return sqlite3_last_insert_rowid (mdb.get ()); }
@@ -71,6 +176,74 @@ public:
         sqlite3_finalize (stmt);
         return mstatus;
     }
+
+private:
+    connection (std::string const& s, int flags)
+        : mbusy (std::make_shared<busy_state> ()),
+          mcache (std::make_shared<std::map<std::string,statement>> ())
+    {
+        sqlite3* pdb = nullptr;
+        mstatus = sqlite3_open_v2 (s.c_str (), &pdb, flags, nullptr);
+        mdb = std::shared_ptr<struct sqlite3>(pdb, sqlite3_close_v2);
+        mbusy->timeout = 0;
+    }
+
+    // back off 1, 2, 5, 10, ... 100 ms while the total stays in the timeout.
+    static int busy_handler (void* p, int count)
+    {
+        static const int DELAY[] = {1, 2, 5, 10, 15, 20, 25, 25, 25, 50, 50, 100};
+        static const int NDELAY = sizeof (DELAY) / sizeof (DELAY[0]);
+        busy_state* busy = static_cast<busy_state*> (p);
+        if (0 == count)
+            ++busy->stats.busy;
+        int prior = 0;
+        for (int i = 0; i < count; ++i)
+            prior += DELAY[i < NDELAY ? i : NDELAY - 1];
+        int delay = DELAY[count < NDELAY ? count : NDELAY - 1];
+        if (prior + delay > busy->timeout)
+            delay = busy->timeout - prior;
+        if (delay <= 0) {
+            ++busy->stats.timeout;
+            return 0;
+        }
+        auto const t0 = std::chrono::steady_clock::now ();
+        ::usleep (delay * 1000);
+        auto const t1 = std::chrono::steady_clock::now ();
+        busy->stats.wait_usec +=
+            std::chrono::duration_cast<std::chrono::microseconds> (t1 - t0).count ();
+        return 1;
+    }
+};
+
+// connections kept open between the requests served by one process,
+// so that they keep their page cache and prepared statements warm.
+// not thread safe: a process serves one request at a time.
+class pool {
+private:
+    std::string const mname;
+    options const mopt;
+    std::size_t const mmax;
+    std::vector<connection> midle;
+public:
+    pool (std::string const& s, options const& opt, std::size_t max)
+        : mname (s), mopt (opt), mmax (max), midle () {}
+
+    // an idle connection, or a new one when none is left.
+    connection acquire ()
+    {
+        if (midle.empty ())
+            return connection (mname, mopt);
+        connection c = midle.back ();
+        midle.pop_back ();
+        return c;
+    }
+
+    // kept for the next request while fewer than max are idle.
+    void release (connection const& c)
+    {
+        if (midle.size () < mmax)
+            midle.push_back (c);
+    }
 };
 
 } // namespace sqlite3pp
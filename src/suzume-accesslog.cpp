@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <ctime>
+#include "access-log.hpp"
+
+/* print the binary access log as text
+ *
+ *      $ suzume-accesslog data/suzume.access
+ *      2015-06-01T12:00:00.123456Z GET /suzume.cgi 200 0 1234 850 790 120 0
+ *
+ * the fields are the time in UTC, the method, the path, the status, the
+ * bytes of the request and of the response, and the microseconds of the
+ * total, the call, the render and the commit.
+ */
+
+static char const* const METHOD[] = {"GET", "POST", "HEAD", "OTHER"};
+
+static void
+print (access_log::record const& r)
+{
+    time_t const sec = r.time_usec / 1000000;
+    struct tm tm;
+    char date[32];
+    ::gmtime_r (&sec, &tm);
+    std::strftime (date, sizeof (date), "%Y-%m-%dT%H:%M:%S", &tm);
+    int const path_size = std::min<int> (r.path_size, sizeof (r.path));
+    std::printf ("%s.%06uZ %s %.*s %u %llu %llu %u %u %u %u\n",
+        date, static_cast<unsigned> (r.time_usec % 1000000),
+        METHOD[r.method < 4 ? r.method : 3], path_size, r.path, r.status,
+        static_cast<unsigned long long> (r.bytes_in),
+        static_cast<unsigned long long> (r.bytes_out),
+        r.usec[access_log::TOTAL], r.usec[access_log::CALL],
+        r.usec[access_log::RENDER], r.usec[access_log::COMMIT]);
+}
+
+int
+main (int argc, char* argv[])
+{
+    if (argc != 2) {
+        std::fprintf (stderr, "usage: %s ACCESS_LOG\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::FILE* in = std::fopen (argv[1], "rb");
+    if (in == nullptr) {
+        std::perror (argv[1]);
+        return EXIT_FAILURE;
+    }
+    access_log::record r;
+    std::size_t n;
+    while ((n = std::fread (&r, 1, sizeof (r), in)) == sizeof (r))
+        print (r);
+    std::fclose (in);
+    if (n != 0) {
+        std::fprintf (stderr, "%s: truncated record\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "sqlite3pp.hpp"
+#include "archive.hpp"
+
+/* move the old entries out of the live table into archive segments
+ *
+ *      $ suzume-archive data/suzume.db data/archive 1000
+ *
+ * keeps the newest 1000 entries in the database. each segment is
+ * written whole before its rows are deleted from the database, and the
+ * readers take the archive for the ids at or below its newest one, so
+ * that an interrupted run leaves the rows readable in either tier. the
+ * rows it has left in the database are deleted at the next run.
+ */
+
+enum { SEGMENT_ROWS = 4096 };
+
+static bool
+select_rows (sqlite3pp::connection& dbh, sqlite3_int64 floor, sqlite3_int64 keep,
+             std::vector<archive::row_type>& rows)
+{
+    sqlite3pp::statement sth = dbh.prepare (
+        "SELECT id, body, html FROM entries"
+        " WHERE id > ?1 AND id <= (SELECT max(id) FROM entries) - ?2"
+        " ORDER BY id ASC LIMIT ?3;");
+    if (! sth.prepared ())
+        return false;
+    sth.bind (1, floor);
+    sth.bind (2, keep);
+    sth.bind (3, static_cast<int> (SEGMENT_ROWS));
+    rows.clear ();
+    int rc;
+    while (SQLITE_ROW == (rc = sth.step ())) {
+        archive::row_type row;
+        row.id = sth.column_int64 (0);
+        sth.column_string (1, row.body);
+        row.has_html = SQLITE_NULL != sth.column_type (2);
+        if (row.has_html)
+            sth.column_string (2, row.html);
+        rows.push_back (row);
+    }
+    return SQLITE_DONE == rc;
+}
+
+static bool
+delete_rows (sqlite3pp::connection& dbh, sqlite3_int64 last_id)
+{
+    if (SQLITE_DONE != dbh.execute ("BEGIN IMMEDIATE;"))
+        return false;
+    sqlite3pp::statement sth = dbh.prepare ("DELETE FROM entries WHERE id <= ?;");
+    bool const ok = sth.prepared ()
+        && SQLITE_OK == sth.bind (1, last_id)
+        && SQLITE_DONE == sth.step ();
+    if (ok && SQLITE_DONE == dbh.execute ("COMMIT;"))
+        return true;
+    dbh.execute ("ROLLBACK;");
+    return false;
+}
+
+int
+main (int argc, char* argv[])
+{
+    // the newest entry is always kept: entries.id is not AUTOINCREMENT,
+    // and a table emptied would give the next post an id at or below the
+    // archive, where the pages never look for it.
+    char* end = nullptr;
+    sqlite3_int64 const keep = argc == 4 ? std::strtoll (argv[3], &end, 10) : 0;
+    if (argc != 4 || end == argv[3] || *end != '\0' || keep < 1) {
+        std::fprintf (stderr, "usage: %s DATABASE ARCHIVE_DIR KEEP\n"
+            "KEEP is the number of the newest entries left, at least 1.\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::string const dbname = argv[1];
+    std::string const dir = argv[2];
+    sqlite3pp::options opt;
+    opt.journal_mode = "WAL";
+    opt.busy_timeout = 10000;
+    sqlite3pp::connection dbh (dbname, opt);
+    if (SQLITE_OK != dbh.status ()) {
+        std::fprintf (stderr, "%s: %s\n", dbname.c_str (), dbh.errmsg ().c_str ());
+        return EXIT_FAILURE;
+    }
+    sqlite3_int64 floor;
+    {
+        archive cold (dir);
+        floor = cold.newest_id ();
+    }
+    if (floor > 0 && ! delete_rows (dbh, floor)) {
+        std::fprintf (stderr, "%s: %s\n", dbname.c_str (), dbh.errmsg ().c_str ());
+        return EXIT_FAILURE;
+    }
+    std::size_t total = 0;
+    std::vector<archive::row_type> rows;
+    for (;;) {
+        if (! select_rows (dbh, floor, keep, rows)) {
+            std::fprintf (stderr, "%s: %s\n", dbname.c_str (), dbh.errmsg ().c_str ());
+            return EXIT_FAILURE;
+        }
+        if (rows.empty ())
+            break;
+        if (! archive::write_segment (dir, rows)) {
+            std::perror (dir.c_str ());
+            return EXIT_FAILURE;
+        }
+        floor = rows.back ().id;
+        if (! delete_rows (dbh, floor)) {
+            std::fprintf (stderr, "%s: %s\n", dbname.c_str (), dbh.errmsg ().c_str ());
+            return EXIT_FAILURE;
+        }
+        total += rows.size ();
+    }
+    std::printf ("%zu entries archived\n", total);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// the rendered front page, tagged with the state it was rendered from.
+// kept in memory and in a file shared by the CGI processes, a file for
+// each content coding of the page: path itself, path.gzip and so on.
+struct suzume_cache {
+    explicit suzume_cache (std::string const& a) : path (a), mvariant () {}
+
+    bool load (std::string const& tag, std::string& body, std::string const& coding = "")
+    {
+        if (tag.empty ())
+            return false;
+        variant_type& v = mvariant[coding];
+        if (v.tag != tag && ! read_file (filename (coding), tag, v))
+            return false;
+        body = v.body;
+        return true;
+    }
+
+    void store (std::string const& tag, std::string const& body, std::string const& coding = "")
+    {
+        variant_type& v = mvariant[coding];
+        if (tag.empty () || v.tag == tag)
+            return;
+        v.tag = tag;
+        v.body = body;
+        write_file (filename (coding), v);
+    }
+
+    // modification time and size of a file, such as the template.
+    static std::string stamp (std::string const& name)
+    {
+        struct stat st;
+        if (::stat (name.c_str (), &st) < 0)
+            return "";
+        return std::to_string (st.st_mtime) + "." + std::to_string (st.st_size);
+    }
+
+private:
+    struct variant_type {
+        std::string tag;
+        std::string body;
+    };
+    std::string const path;
+    std::map<std::string,variant_type> mvariant;
+
+    std::string filename (std::string const& coding) const
+    {
+        return coding.empty () ? path : path + "." + coding;
+    }
+
+    // the file holds the tag on the first line and the body after it.
+    static bool read_file (std::string const& name, std::string const& tag, variant_type& v)
+    {
+        std::FILE* in = std::fopen (name.c_str (), "rb");
+        if (in == nullptr)
+            return false;
+        std::string buf;
+        char chunk[4096];
+        for (std::size_t n; (n = std::fread (chunk, 1, sizeof (chunk), in)) > 0; )
+            buf.append (chunk, n);
+        std::fclose (in);
+        std::size_t const eol = buf.find ('\n');
+        if (eol == buf.npos || buf.compare (0, eol, tag) != 0)
+            return false;
+        v.tag = tag;
+        v.body.assign (buf, eol + 1, buf.npos);
+        return true;
+    }
+
+    // written aside and renamed, so that readers never see a partial file.
+    static void write_file (std::string const& name, variant_type const& v)
+    {
+        std::string const tmpname = name + "." + std::to_string (::getpid ());
+        std::FILE* out = std::fopen (tmpname.c_str (), "wb");
+        if (out == nullptr)
+            return;
+        bool ok = std::fwrite (v.tag.data (), 1, v.tag.size (), out) == v.tag.size ()
+            && std::fputc ('\n', out) != EOF
+            && std::fwrite (v.body.data (), 1, v.body.size (), out) == v.body.size ();
+        ok = std::fclose (out) == 0 && ok;
+        if (! ok || std::rename (tmpname.c_str (), name.c_str ()) != 0)
+            std::remove (tmpname.c_str ());
+    }
+};
@@ -1,48 +1,291 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <utility>
 #include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "sqlite3pp.hpp"
+#include "archive.hpp"
+
+// a page of the entries: those matching the query when it is given,
+// those older than before, or those newer than after, or the newest ones.
+struct suzume_cursor {
+    sqlite3_int64 before;
+    sqlite3_int64 after;
+    int limit;
+    std::string query;
+};
 
 struct suzume_data {
-    explicit suzume_data (std::string const& a) : dbname (a), dbh (a), sth (nullptr) {}
+    suzume_data (std::string const& a, sqlite3pp::options const& opt)
+        : suzume_data (sqlite3pp::connection (a, opt)) {}
+
+    // on a connection shared with the others, such as one from a pool.
+    explicit suzume_data (sqlite3pp::connection const& a)
+        : dbh (a), begin_sth (), insert_sth (), commit_sth (),
+          rollback_sth (), newest_sth (), recents_sth (), before_sth (), after_sth (),
+          newer_sth (), older_sth (), search_sth (), cursor (nullptr),
+          cold (nullptr), cold_rows (), cold_pos (0), cold_fill (0), cold_before (0) {}
+
+    // the entries moved out of the live table are read from the archive,
+    // and the live table holds the ones newer than the archive.
+    void tier (archive const* a) { cold = a; }
 
-    void insert (std::string const& body)
+    // false when the write lock could not be taken in the busy timeout.
+    bool insert (std::string const& body, std::string const& html)
     {
-        dbh.execute ("BEGIN;");
-        auto sth = dbh.prepare ("INSERT INTO entries VALUES (NULL, ?);");
-        sth.bind (1, body);
-        if (SQLITE_DONE == sth.step ())
-            dbh.execute ("COMMIT;");
-        else
-            dbh.execute ("ROLLBACK;");
+        return insert (std::vector<std::vector<std::string>> {{body, html}});
     }
 
-    void recents_iter (void)
+    // insert the rows of body and html in one transaction.
+    bool insert (std::vector<std::vector<std::string>> const& rows)
     {
-        sth = std::make_shared<sqlite3pp::statement> (
-            dbh.prepare ("SELECT body FROM entries ORDER BY id DESC LIMIT 20;"));
+        if (SQLITE_DONE != prepared (begin_sth, "BEGIN IMMEDIATE;").step ())
+            return false;
+        bool ok = true;
+        for (auto it = rows.cbegin (); ok && it != rows.cend (); ++it) {
+            auto& sth = prepared (insert_sth, "INSERT INTO entries (body, html) VALUES (?, ?);");
+            ok = it->size () == 2
+                && SQLITE_OK == sth.bind_static (1, (*it)[0].data (), (*it)[0].size ())
+                && SQLITE_OK == sth.bind_static (2, (*it)[1].data (), (*it)[1].size ())
+                && SQLITE_DONE == sth.step ();
+        }
+        // the rows are bound in place, so that unbound before they go.
+        if (insert_sth.prepared ()) {
+            insert_sth.reset ();
+            insert_sth.clear_bindings ();
+        }
+        if (ok && SQLITE_DONE == prepared (commit_sth, "COMMIT;").step ())
+            return true;
+        prepared (rollback_sth, "ROLLBACK;").step ();
+        return false;
+    }
+
+    // a long body spooled in the file is bound as the text of its row
+    // straight from the map of the file, and inserted by itself, without
+    // the html, which the view escapes from the body. false when the
+    // write lock could not be taken, or the file could not be mapped.
+    bool insert (std::FILE* in, std::size_t size)
+    {
+        struct stat st;
+        if (::fstat (fileno (in), &st) < 0 || st.st_size < static_cast<off_t> (size))
+            return false;
+        void* const body = ::mmap (nullptr, size, PROT_READ, MAP_PRIVATE, fileno (in), 0);
+        if (MAP_FAILED == body)
+            return false;
+        auto& sth = prepared (insert_sth, "INSERT INTO entries (body, html) VALUES (?, ?);");
+        bool const ok = SQLITE_OK == sth.bind_static (1, static_cast<char const*> (body), size)
+            && SQLITE_DONE == sth.step ();
+        sth.reset ();
+        sth.clear_bindings ();
+        ::munmap (body, size);
+        return ok;
+    }
+
+    sqlite3pp::lock_stats const& lock_stats () const { return dbh.stats (); }
+
+    // the newest entry is never archived, so that the archive is asked
+    // only when the live table is empty.
+    sqlite3_int64 newest_id (void)
+    {
+        auto& sth = prepared (newest_sth, "SELECT max(id) FROM entries;");
+        sqlite3_int64 const id = SQLITE_ROW == sth.step () ? sth.column_int64 (0) : 0;
+        sth.reset ();
+        return id > 0 ? id : floor ();
+    }
+
+    // each page is a range scan on the primary key from the cursor,
+    // and ?2 is the page size in all of them. ?3 is the newest id in
+    // the archive: the live rows at or below it have been archived.
+    // the live rows come first, and the archive fills the rest of the
+    // page with the older ones.
+    void recents_iter (suzume_cursor const& page)
+    {
+        cold_rows.clear ();
+        cold_pos = cold_fill = 0;
+        if (! page.query.empty ()) {
+            search_iter (page);
+            return;
+        }
+        int limit = page.limit;
+        if (page.before > 0) {
+            cursor = &prepared (before_sth,
+                "SELECT id, body, html FROM entries WHERE id < ?1 AND id > ?3"
+                " ORDER BY id DESC LIMIT ?2;");
+            cursor->bind (1, page.before);
+            cold_fill = page.limit;
+            cold_before = std::min (page.before, floor () + 1);
+        }
+        else if (page.after > 0) {
+            if (cold != nullptr && page.after < floor ()) {
+                cold->after (page.after, page.limit, cold_rows);
+                std::reverse (cold_rows.begin (), cold_rows.end ());
+                limit -= cold_rows.size ();
+            }
+            cursor = &prepared (after_sth,
+                "SELECT id, body, html FROM (SELECT id, body, html FROM entries"
+                " WHERE id > ?1 AND id > ?3 ORDER BY id ASC LIMIT ?2) ORDER BY id DESC;");
+            cursor->bind (1, page.after);
+        }
+        else {
+            cursor = &prepared (recents_sth,
+                "SELECT id, body, html FROM entries WHERE id > ?3"
+                " ORDER BY id DESC LIMIT ?2;");
+            cold_fill = page.limit;
+            cold_before = floor () + 1;
+        }
+        cursor->bind (2, limit);
+        cursor->bind (3, floor ());
+        if (! cursor->prepared ())
+            cursor = nullptr;
     }
 
     bool recents_step (void)
     {
-        if (sth == nullptr)
+        if (cursor != nullptr) {
+            if (SQLITE_ROW == cursor->step ()) {
+                --cold_fill;
+                return true;
+            }
+            cursor->reset ();
+            cursor = nullptr;
+            if (cold != nullptr && cold_fill > 0)
+                cold->before (cold_before, cold_fill, cold_rows);
+        }
+        if (cold_pos >= cold_rows.size ())
             return false;
-        if (SQLITE_ROW == sth->step ())
+        ++cold_pos;
+        return true;
+    }
+
+    sqlite3_int64 recents_id (void)
+    {
+        if (cursor != nullptr)
+            return cursor->column_int64 (0);
+        archive::entry const* row = cold_row ();
+        return row != nullptr ? row->id : 0;
+    }
+
+    void recents_body (char const*& first, char const*& last)
+    {
+        std::size_t size = 0;
+        archive::entry const* row = cold_row ();
+        first = nullptr;
+        if (cursor != nullptr)
+            first = cursor->column_text (1, size);
+        else if (row != nullptr) {
+            first = row->body;
+            size = row->body_size;
+        }
+        last = first + size;
+    }
+
+    // the pre-escaped body in the row, false if the row has not got one.
+    // it stays valid until the next recents_step.
+    bool recents_html (char const*& first, char const*& last)
+    {
+        if (cursor != nullptr) {
+            if (SQLITE_NULL == cursor->column_type (2))
+                return false;
+            std::size_t size;
+            first = cursor->column_text (2, size);
+            last = first + size;
             return true;
-        sth = nullptr;
-        return false;
+        }
+        archive::entry const* row = cold_row ();
+        if (row == nullptr || row->html == nullptr)
+            return false;
+        first = row->html;
+        last = first + row->html_size;
+        return true;
     }
 
-    void recents_body (std::string& body)
+    // the query is searched as a phrase through the trigram index, and
+    // the body column holds a snippet with the hits between 0x01 and 0x02.
+    void search_iter (suzume_cursor const& page)
     {
-        if (sth != nullptr)
-            sth->column_string (0, body);
+        std::string phrase = "\"";
+        for (char const c : page.query)
+            phrase += '"' == c ? "\"\"" : std::string (1, c);
+        phrase += "\"";
+        cursor = &prepared (search_sth,
+            "SELECT rowid, snippet (entries_fts, 0, char (1), char (2), '...', 24), NULL"
+            " FROM entries_fts WHERE entries_fts MATCH ?1 ORDER BY rank LIMIT ?2;");
+        cursor->bind (1, phrase);
+        cursor->bind (2, page.limit);
+        if (! cursor->prepared ())
+            cursor = nullptr;
+    }
+
+    bool has_newer (sqlite3_int64 id)
+    {
+        return id < floor () || exists (prepared (newer_sth,
+            "SELECT EXISTS (SELECT 1 FROM entries WHERE id > ?);"), id);
+    }
+
+    // the archive holds the floor itself, and is mapped only for an id
+    // at or below it.
+    bool has_older (sqlite3_int64 id)
+    {
+        sqlite3_int64 const f = floor ();
+        return (f > 0 && (f < id || cold->oldest_id () < id))
+            || exists (prepared (older_sth,
+                "SELECT EXISTS (SELECT 1 FROM entries WHERE id < ?);"), id);
     }
 
 private:
-    std::string const dbname;
     sqlite3pp::connection dbh;
-    std::shared_ptr<sqlite3pp::statement> sth;
+    sqlite3pp::statement begin_sth;
+    sqlite3pp::statement insert_sth;
+    sqlite3pp::statement commit_sth;
+    sqlite3pp::statement rollback_sth;
+    sqlite3pp::statement newest_sth;
+    sqlite3pp::statement recents_sth;
+    sqlite3pp::statement before_sth;
+    sqlite3pp::statement after_sth;
+    sqlite3pp::statement newer_sth;
+    sqlite3pp::statement older_sth;
+    sqlite3pp::statement search_sth;
+    sqlite3pp::statement* cursor;
+    archive const* cold;
+    std::vector<archive::entry> cold_rows;
+    std::size_t cold_pos;           // next row of cold_rows
+    int cold_fill;                  // rows left for the archive to fill
+    sqlite3_int64 cold_before;
+
+    // the current row read from the archive, if any.
+    archive::entry const* cold_row () const
+    {
+        return cursor == nullptr && cold_pos > 0 ? &cold_rows[cold_pos - 1] : nullptr;
+    }
+
+    sqlite3_int64 floor () const
+    {
+        return cold != nullptr ? cold->newest_id () : 0;
+    }
+
+    bool exists (sqlite3pp::statement& sth, sqlite3_int64 id)
+    {
+        sth.bind (1, id);
+        bool const found = SQLITE_ROW == sth.step () && sth.column_int (0) != 0;
+        sth.reset ();
+        return found;
+    }
+
+    // statements are prepared at their first use and kept for the
+    // lifetime of the connection, reset before each later use.
+    sqlite3pp::statement& prepared (sqlite3pp::statement& sth, char const* sql)
+    {
+        if (sth.prepared ()) {
+            sth.reset ();
+            sth.clear_bindings ();
+        }
+        else
+            sth = dbh.cache (sql);
+        return sth;
+    }
 };
@@ -1,60 +1,210 @@
 #pragma once
 
 #include <string>
-#include <fstream>
+#include <cstdio>
 #include "suzume_data.hpp"
+#include "suzume_cache.hpp"
 #include "mustache.hpp"
 
+#ifdef SUZUME_EMBED_TEMPLATE
+// generated from the template by embed-template at build time.
+extern char const suzume_template[];
+extern std::size_t const suzume_template_size;
+extern char const suzume_template_stamp[];
+#endif
+
 struct suzume_view : public mustache::page_base {
-    enum { RECENTS, BODY };
+    enum {
+        RECENTS, BODY, RECENTS_CACHE, NEWER, OLDER, NEWER_ID, OLDER_ID,
+        SEARCH, QUERY
+    };
+
+    // the recents are cached by the newest id c, and not at all when c is 0.
+    suzume_view (suzume_data& a, suzume_cursor const& b, sqlite3_int64 c)
+        : data (a), page (b), html (), newest_id (c), newest (0), oldest (0) {}
+
+    // entries are stored with their body escaped once at posting.
+    static void escape (std::string const& body, std::string& html)
+    {
+        mustache::page_base::append_html (2, body.cbegin (), body.cend (), html);
+    }
 
-    explicit suzume_view (suzume_data& a, std::string const& b)
-        : data (a), srcname (b) {}
+    // the C0 controls are refused in a body but tab, newline, and return,
+    // for the search snippets mark their hits with 0x01 and 0x02.
+    static bool postable (char const* first, char const* last)
+    {
+        for (char const* s = first; s < last; ++s)
+            if (static_cast<unsigned char> (*s) < 0x20U && '\t' != *s && '\n' != *s && '\r' != *s)
+                return false;
+        return true;
+    }
 
-    bool render (std::string& output)
+    static bool load (mustache::layout_type& layout, std::string const& srcname)
     {
         std::string src;
-        if (! slurp (src))
-            return false;
-        mustache::layout_type layout;
-        layout.bind ("recents", RECENTS, mustache::FOR);
-        layout.bind ("body",    BODY,    mustache::STRING);
-        if (! layout.assemble (src))
+#ifdef SUZUME_EMBED_TEMPLATE
+        src.assign (suzume_template, suzume_template_size);
+#else
+        if (! slurp (srcname, src))
             return false;
+#endif
+        layout.bind ("recents",       RECENTS,       mustache::FOR);
+        layout.bind ("body",          BODY,          mustache::STRITER);
+        layout.bind ("recents_cache", RECENTS_CACHE, mustache::CACHE);
+        layout.bind ("newer",         NEWER,         mustache::IF);
+        layout.bind ("older",         OLDER,         mustache::IF);
+        layout.bind ("newer_id",      NEWER_ID,      mustache::INTEGER);
+        layout.bind ("older_id",      OLDER_ID,      mustache::INTEGER);
+        layout.bind ("search",        SEARCH,        mustache::IF);
+        layout.bind ("query",         QUERY,         mustache::STRING);
+        return layout.assemble (src, true);
+    }
+
+    // the version of the template, which is built in or read from the file.
+    static std::string stamp (std::string const& srcname)
+    {
+#ifdef SUZUME_EMBED_TEMPLATE
+        return suzume_template_stamp;
+#else
+        return suzume_cache::stamp (srcname);
+#endif
+    }
+
+    void render (mustache::layout_type const& layout, std::string& output)
+    {
         layout.expand (*this, output);
-        return true;
+    }
+
+    void render (mustache::layout_type const& layout, mustache::output_sink& sink)
+    {
+        layout.expand (*this, sink);
     }
 
     void iter (int symbol)
     {
-        if (RECENTS == symbol) data.recents_iter ();
+        if (RECENTS == symbol) {
+            newest = oldest = 0;
+            data.recents_iter (page);
+        }
     }
 
+    // the pager links follow the ids at both ends of the page.
+    // search results are ranked, so that they have no pager.
     void valueof (int symbol, bool& v)
     {
-        if (RECENTS == symbol) v = data.recents_step ();
+        bool const search = ! page.query.empty ();
+        if (RECENTS == symbol) v = step ();
+        else if (SEARCH == symbol) v = search;
+        else if (NEWER == symbol) v = ! search && newest > 0 && data.has_newer (newest);
+        else if (OLDER == symbol) v = ! search && oldest > 0 && data.has_older (oldest);
+    }
+
+    void valueof (int symbol, long& v)
+    {
+        if (NEWER_ID == symbol) v = newest;
+        else if (OLDER_ID == symbol) v = oldest;
     }
 
     void valueof (int symbol, std::string& v)
     {
-        if (BODY == symbol) data.recents_body (v);
+        if (RECENTS_CACHE == symbol && page.query.empty () && newest_id > 0)
+            v = std::to_string (newest_id) + ":"
+              + std::to_string (page.before) + ":" + std::to_string (page.after);
+        else if (QUERY == symbol)
+            v = page.query;
+    }
+
+    // the body goes from the row to the output without a copy,
+    // unless it has to be escaped here.
+    void valueof (int symbol, char const*& v1, char const*& v2)
+    {
+        if (BODY == symbol && ! data.recents_html (v1, v2)) {
+            html.clear ();
+            recents_html (html);
+            v1 = html.data ();
+            v2 = v1 + html.size ();
+        }
+    }
+
+    // the whole page of the recents in one block, the bodies read in
+    // place from the rows, or escaped straight into the block.
+    bool batch (int symbol, mustache::column_block& block)
+    {
+        if (RECENTS != symbol)
+            return false;
+        block.symbol.assign (1, BODY);
+        block.clear ();
+        iter (RECENTS);
+        while (step ()) {
+            char const* v1;
+            char const* v2;
+            if (data.recents_html (v1, v2))
+                block.push_back (v1, v2 - v1);
+            else {
+                recents_html (block.buffer);
+                block.offset.push_back (block.buffer.size ());
+            }
+        }
+        return true;
     }
 
 private:
     suzume_data& data;
-    std::string const srcname;
+    suzume_cursor const page;
+    std::string html;
+    sqlite3_int64 const newest_id;
+    sqlite3_int64 newest;
+    sqlite3_int64 oldest;
 
-    bool slurp (std::string& src)
+    bool step ()
     {
-        std::ifstream is (srcname, std::ifstream::binary);
-        if (! is)
+        if (! data.recents_step ())
             return false;
-        is.seekg (0, is.end);
-        std::size_t n = is.tellg ();
-        is.seekg (0, is.beg);
-        src.resize (n, ' ');
-        is.read (&src[0], n);
-        is.close ();
+        oldest = data.recents_id ();
+        if (0 == newest)
+            newest = oldest;
         return true;
     }
+
+    // rows posted before the html column existed are escaped here,
+    // and so are the search snippets, marking the hits. a marker left
+    // in a body posted before the controls were refused is not let
+    // unbalance the tags.
+    void recents_html (std::string& output)
+    {
+        char const* first;
+        char const* last;
+        data.recents_body (first, last);
+        if (page.query.empty ()) {
+            append_html (2, first, last, output);
+            return;
+        }
+        bool marked = false;
+        for (char const* s = first; s < last; ++s) {
+            if ('\x01' == *s || '\x02' == *s) {
+                append_html (2, first, s, output);
+                if (('\x01' == *s) != marked)
+                    output += marked ? "</mark>" : "<mark>";
+                marked = '\x01' == *s;
+                first = s + 1;
+            }
+        }
+        append_html (2, first, last, output);
+        if (marked)
+            output += "</mark>";
+    }
+
+    static bool slurp (std::string const& srcname, std::string& src)
+    {
+        std::FILE* in = std::fopen (srcname.c_str (), "rb");
+        if (in == nullptr)
+            return false;
+        src.clear ();
+        char chunk[4096];
+        for (std::size_t n; (n = std::fread (chunk, 1, sizeof (chunk), in)) > 0; )
+            src.append (chunk, n);
+        bool const ok = ! std::ferror (in);
+        std::fclose (in);
+        return ok;
+    }
 };